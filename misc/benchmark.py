@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This script times Filtlong commands, so different options (or different Filtlong builds) can be
+compared on the same input. Each variant is a name and some extra options, and every variant is
+run the given number of times, interleaved so they all see similar conditions. The fastest and
+median wall times are reported, along with peak memory.
+
+With --output_dir, each run's stdout is written to a file in that directory (rather than to
+/dev/null) and the output rate is reported too, in MB of output per second of wall time.
+
+With --cold, the input files are dropped from the page cache before every run, so the timing
+includes reading them from disk. This uses posix_fadvise, which works without root privileges but
+can only drop pages which aren't in use elsewhere.
+
+Example commands:
+  benchmark.py --cold --variant pread= --variant io_uring=--io_uring -- --keep_percent 90 reads.fastq.gz
+  benchmark.py --variant old=--threads=1 --variant new=--threads=8 -- --target_bases 500m reads/
+  benchmark.py --variant qscore= --variant "ref=-a ref.fasta" --variant "trim=-a ref.fasta --trim" \
+               --variant "split=-a ref.fasta --split 200" -- --keep_percent 90 reads.fastq
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+
+def main():
+    args = get_arguments()
+    variants = [parse_variant(v) for v in args.variant] if args.variant else [('default', [])]
+    inputs = [x for x in args.filtlong_args if os.path.exists(x)]
+
+    times = {name: [] for name, _ in variants}
+    memory = {name: 0 for name, _ in variants}
+    output_sizes = {name: 0 for name, _ in variants}
+    output_path = os.path.join(args.output_dir, 'benchmark_output') if args.output_dir else os.devnull
+    for _ in range(args.runs):
+        for name, options in variants:
+            if args.cold:
+                drop_from_page_cache(inputs)
+            command = [args.filtlong] + options + args.filtlong_args
+            start = time.perf_counter()
+            with open(output_path, 'wb') as output:
+                p = subprocess.Popen(command, stdout=output, stderr=subprocess.DEVNULL)
+                _, status, usage = os.wait4(p.pid, 0)
+            elapsed = time.perf_counter() - start
+            if status != 0:
+                sys.exit('Error: ' + ' '.join(command) + ' failed')
+            times[name].append(elapsed)
+            memory[name] = max(memory[name], usage.ru_maxrss)
+            if args.output_dir:
+                output_sizes[name] = os.path.getsize(output_path)
+    if args.output_dir:
+        os.remove(output_path)
+
+    header = ['variant', 'fastest (s)', 'median (s)', 'peak memory (MB)']
+    if args.output_dir:
+        header.append('output (MB/s)')
+    print('\t'.join(header))
+    for name, _ in variants:
+        row = [name, '%.3f' % min(times[name]), '%.3f' % statistics.median(times[name]),
+               '%.1f' % (memory[name] / 1024)]
+        if args.output_dir:
+            row.append('%.1f' % (output_sizes[name] / 1000000 / statistics.median(times[name])))
+        print('\t'.join(row))
+
+
+def get_arguments():
+    parser = argparse.ArgumentParser(description='Time Filtlong commands')
+    parser.add_argument('--filtlong', default=os.path.join(os.path.dirname(os.path.dirname(
+                        os.path.abspath(__file__))), 'bin', 'filtlong'), help='Filtlong binary')
+    parser.add_argument('--runs', type=int, default=3, help='runs of each variant')
+    parser.add_argument('--cold', action='store_true', help='drop inputs from the page cache before each run')
+    parser.add_argument('--output_dir', help='write output here and report the output rate')
+    parser.add_argument('--variant', action='append',
+                        help='NAME=OPTIONS, extra options for one variant (can be repeated)')
+    parser.add_argument('filtlong_args', nargs=argparse.REMAINDER, help='options and inputs for every run')
+    args = parser.parse_args()
+    if args.filtlong_args and args.filtlong_args[0] == '--':
+        args.filtlong_args = args.filtlong_args[1:]
+    return args
+
+
+def parse_variant(variant):
+    name, _, options = variant.partition('=')
+    return name, options.split()
+
+
+def drop_from_page_cache(paths):
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            files += [os.path.join(path, f) for f in os.listdir(path)]
+        else:
+            files.append(path)
+    for f in files:
+        fd = os.open(f, os.O_RDONLY)
+        os.fsync(fd)
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+        os.close(fd)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This script makes a random reference and a set of ultra-long reads from it, for benchmarking
+Filtlong's trimming and splitting. Each read is made of reference segments separated by short runs
+of random bases, so with --split each read is cut into many child reads. The reference is saved
+as a FASTA file and the reads as a FASTQ file, in the given directory.
+
+Example commands:
+  make_split_reads.py split_bench
+  benchmark.py --output_dir /tmp --variant "split=-a split_bench/reference.fasta --split 100" \
+               -- --min_length 1 split_bench/reads.fastq
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import argparse
+import os
+import random
+
+QUALITY_CHARS = [chr(q) for q in range(43, 74)]  # Phred 10 to 40
+
+
+def main():
+    args = get_arguments()
+    random.seed(args.seed)
+    os.makedirs(args.out_dir, exist_ok=True)
+
+    reference = random_bases(args.reference_length)
+    with open(os.path.join(args.out_dir, 'reference.fasta'), 'wt') as fasta:
+        fasta.write('>reference\n' + reference + '\n')
+
+    with open(os.path.join(args.out_dir, 'reads.fastq'), 'wt') as fastq:
+        for i in range(args.read_count):
+            parts = []
+            for j in range(args.pieces):
+                if j > 0:
+                    parts.append(random_bases(args.gap_length))
+                start = random.randint(0, args.reference_length - args.piece_length)
+                parts.append(reference[start:start + args.piece_length])
+            seq = ''.join(parts)
+            qual = ''.join(random.choices(QUALITY_CHARS, k=len(seq)))
+            fastq.write('@read_' + str(i + 1) + '\n' + seq + '\n+\n' + qual + '\n')
+
+
+def random_bases(length):
+    return ''.join(random.choices('ACGT', k=length))
+
+
+def get_arguments():
+    parser = argparse.ArgumentParser(description='Make ultra-long reads which split into many parts')
+    parser.add_argument('out_dir', help='directory for reference.fasta and reads.fastq')
+    parser.add_argument('--read_count', type=int, default=20, help='number of reads')
+    parser.add_argument('--pieces', type=int, default=20, help='reference segments per read')
+    parser.add_argument('--piece_length', type=int, default=50000, help='length of each segment')
+    parser.add_argument('--gap_length', type=int, default=200,
+                        help='random bases between segments (more than --split to cause a split)')
+    parser.add_argument('--reference_length', type=int, default=2000000, help='reference length')
+    parser.add_argument('--seed', type=int, default=0, help='random seed')
+    return parser.parse_args()
+
+
+if __name__ == '__main__':
+    main()
@@ -17,10 +17,14 @@
 #include "arguments.h"
 
 #include <iostream>
+#include <cstdlib>
 #include <sys/ioctl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fstream>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
 
 #include "args.h"
 
@@ -113,11 +117,61 @@ void IntWithSuffixReader::operator()(const std::string &name, const std::string
 }
 
 
+static std::vector<std::string> split_list(const std::string &value) {
+    std::vector<std::string> parts;
+    std::istringstream stream(value);
+    std::string part;
+    while (std::getline(stream, part, ','))
+        parts.push_back(part);
+    if (parts.empty() || value.back() == ',')
+        parts.push_back("");
+    return parts;
+}
+
+
+void IntegerListWithSuffixReader::operator()(const std::string &name, const std::string &value,
+                                             std::vector<long long> &destination) {
+    destination.clear();
+    for (auto & part : split_list(value)) {
+        long long n;
+        IntegerWithSuffixReader()(name, part, n);
+        destination.push_back(n);
+    }
+}
+
+
+void DoublesListReader::operator()(const std::string &name, const std::string &value,
+                                   std::vector<double> &destination) {
+    destination.clear();
+    for (auto & part : split_list(value)) {
+        double n;
+        DoublesReader()(name, part, n);
+        destination.push_back(n);
+    }
+}
+
+
+void StringListReader::operator()(const std::string &name, const std::string &value,
+                                  std::vector<std::string> &destination) {
+    destination = split_list(value);
+    for (auto & part : destination) {
+        if (part.empty()) {
+            std::ostringstream problem;
+            problem << "Error: argument '" << name << "' received invalid value '" << value << "'";
+            throw args::ParseError(problem.str());
+        }
+    }
+}
+
+
 typedef args::ValueFlag<double, DoublesReader> d_arg;
 typedef args::ValueFlag<long long> i_arg;
 typedef args::ValueFlag<long long, IntegerWithSuffixReader> ll_suffix_arg;
 typedef args::ValueFlag<int, IntWithSuffixReader> i_suffix_arg;
 typedef args::ValueFlag<std::string> s_arg;
+typedef args::ValueFlag<std::vector<long long>, IntegerListWithSuffixReader> ll_suffix_list_arg;
+typedef args::ValueFlag<std::vector<double>, DoublesListReader> d_list_arg;
+typedef args::ValueFlag<std::vector<std::string>, StringListReader> s_list_arg;
 typedef args::Flag f_arg;
 
 
@@ -148,15 +202,17 @@ Arguments::Arguments(int argc, char **argv) {
     parser.helpParams.flagindent = indent_size;
     parser.helpParams.eachgroupindent = indent_size;
 
-    args::Positional<std::string> input_reads_arg(parser, "input_reads",
-                                      "input long reads to be filtered");
+    args::PositionalList<std::string> input_reads_arg(parser, "input_reads",
+                                      "input long reads to be filtered (files, directories or globs)");
 
     args::Group thresholds_group(parser, "output thresholds:");
-    ll_suffix_arg target_bases_arg(thresholds_group, "int",
-                           "keep only the best reads up to this many total bases (unit suffixes: k, kb, m, mb, g, gb)",
+    ll_suffix_list_arg target_bases_arg(thresholds_group, "int",
+                           "keep only the best reads up to this many total bases (unit suffixes: k, kb, m, mb, g, gb; "
+                           "a comma-separated list gives multiple targets)",
                            {'t', "target_bases"});
-    d_arg keep_percent_arg(thresholds_group, "float",
-                           "keep only this percentage of the best reads (measured by bases)",
+    d_list_arg keep_percent_arg(thresholds_group, "float",
+                           "keep only this percentage of the best reads (measured by bases; a comma-separated list "
+                           "gives multiple targets)",
                            {'p', "keep_percent"});
     i_suffix_arg min_length_arg(thresholds_group, "int",
                          "minimum length threshold (unit suffixes: k, kb, m, mb, g, gb)",
@@ -206,9 +262,64 @@ Arguments::Arguments(int argc, char **argv) {
                     {"split"});
 
     args::Group other_group(parser, "NLother:");    // The NL at the start results in a newline
+    s_list_arg output_arg(other_group, "file",
+                          "write output reads to this file instead of stdout, gzipped if its name ends in .gz "
+                          "(with multiple targets, a comma-separated list of one file per target)",
+                          {'o', "output"});
+    s_arg output_order_arg(other_group, "input|score",
+                           "write output reads in input order ('input') or best first ('score', not with --streaming "
+                           "or --memory_budget) (default: input)",
+                           {"output_order"}, "input");
+    i_arg shards_arg(other_group, "int",
+                     "spread each output over this many files, numbered before the extension (e.g. out_1.fastq.gz, "
+                     "out_2.fastq.gz; requires --output, default: 1)",
+                     {"shards"}, 1);
+    s_arg shard_by_arg(other_group, "reads|bases",
+                       "give --shards reads in turn ('reads'), or give each shard a run of consecutive reads with an "
+                       "equal share of the bases ('bases', not with --streaming) (default: reads)",
+                       {"shard_by"}, "reads");
+    s_arg failed_output_arg(other_group, "file",
+                            "also write the reads which aren't output (and the parts removed by --trim/--split) to "
+                            "this file, gzipped if its name ends in .gz",
+                            {"failed_output"});
+    i_arg compression_level_arg(other_group, "int",
+                                "compression level (0-9) for gzipped and BAM output (default: 6)",
+                                {"compression_level"}, 6);
     i_arg window_size_arg(other_group, "int",
                           "size of sliding window used when measuring window quality (default: 250)",
                           {"window_size"}, 250);
+    i_arg threads_arg(other_group, "int",
+                      "number of threads shared by reference hashing, scoring, sorting, BAM decompression and output "
+                      "compression (default: 1)",
+                      {"threads"}, 1);
+    f_arg io_uring_arg(other_group, "io_uring",
+                       "read input files with io_uring, keeping many large reads in flight (Linux only, falls back to "
+                       "pread if unavailable)",
+                       {"io_uring"});
+    s_arg score_cache_arg(other_group, "file",
+                          "load read scores from this file if it matches the inputs and scoring settings, otherwise "
+                          "save them to it",
+                          {"score_cache"});
+    f_arg streaming_arg(other_group, "streaming",
+                        "output reads as soon as they are scored, in one pass: --target_bases and --keep_percent are "
+                        "met approximately, using an estimated score threshold",
+                        {"streaming"});
+    i_arg warm_up_arg(other_group, "int",
+                      "number of reads used to normalise quality scores before --streaming starts output (default: "
+                      "10000)",
+                      {"warm_up"}, 10000);
+    ll_suffix_arg memory_budget_arg(other_group, "int",
+                                    "keep memory use near this many bytes by spilling read scores to temporary files, "
+                                    "for inputs with too many reads to hold in memory (unit suffixes: k, kb, m, mb, "
+                                    "g, gb)",
+                                    {"memory_budget"});
+    s_arg temp_dir_arg(other_group, "dir",
+                       "directory for temporary files (--memory_budget, --output_order score) (default: $TMPDIR or /tmp)",
+                       {"temp_dir"});
+    s_arg scores_out_arg(other_group, "file",
+                         "write a tab-separated table of each read's scores and whether it was kept to this file, "
+                         "gzipped if its name ends in .gz",
+                         {"scores_out"});
     f_arg verbose_arg(other_group, "verbose",
                       "verbose output to stderr with info for each read",
                       {"verbose"});
@@ -250,18 +361,29 @@ Arguments::Arguments(int argc, char **argv) {
         return;
     }
 
-    input_reads = args::get(input_reads_arg);
-    if (input_reads.empty()) {
+    if (args::get(input_reads_arg).empty()) {
         std::cerr << "Error: input reads are required" << "\n";
         parsing_result = BAD;
         return;
     }
+    for (auto path : args::get(input_reads_arg)) {
+        if (!expand_input_path(path, input_reads)) {
+            std::cerr << "Error: cannot find file: " << path << "\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
 
     target_bases_set = bool(target_bases_arg);
-    target_bases = args::get(target_bases_arg);
+    target_bases_list = args::get(target_bases_arg);
+    target_bases = target_bases_set ? target_bases_list[0] : 0;
 
     keep_percent_set = bool(keep_percent_arg);
-    keep_percent = args::get(keep_percent_arg);
+    keep_percent_list = args::get(keep_percent_arg);
+    keep_percent = keep_percent_set ? keep_percent_list[0] : 0.0;
+
+    target_count = std::max(size_t(1), std::max(target_bases_list.size(), keep_percent_list.size()));
+    outputs = args::get(output_arg);
 
     assembly_set = bool(assembly_arg);
     assembly = args::get(assembly_arg);
@@ -292,9 +414,33 @@ Arguments::Arguments(int argc, char **argv) {
     split_set = bool(split_arg);
     split = args::get(split_arg);
 
+    output_order_score = (args::get(output_order_arg) == "score");
+    shards = args::get(shards_arg);
+    shard_by_bases = (args::get(shard_by_arg) == "bases");
+    failed_output_set = bool(failed_output_arg);
+    failed_output = args::get(failed_output_arg);
+    compression_level = args::get(compression_level_arg);
     window_size = args::get(window_size_arg);
+    threads = int(args::get(threads_arg));
+    io_uring = args::get(io_uring_arg);
+    score_cache_set = bool(score_cache_arg);
+    score_cache = args::get(score_cache_arg);
+    streaming = args::get(streaming_arg);
+    warm_up = args::get(warm_up_arg);
+    memory_budget_set = bool(memory_budget_arg);
+    memory_budget = args::get(memory_budget_arg);
+    temp_dir = args::get(temp_dir_arg);
+    if (temp_dir.empty())
+        temp_dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    scores_out_set = bool(scores_out_arg);
+    scores_out = args::get(scores_out_arg);
     verbose = args::get(verbose_arg);
 
+    // A score cache always holds window qualities, so it stays valid if the weights change in a later run.
+    window_quality_needed = (window_q_weight != 0.0 || min_window_q_set || verbose || score_cache_set ||
+                             scores_out_set);
+    failed_read_scores_needed = (verbose || score_cache_set || scores_out_set);
+
     bool some_reference = (short_reads.size() > 0 || assembly_set);
     if (trim && !some_reference) {
         std::cerr << "Error: assembly or read reference is required to use --trim" << "\n";
@@ -308,8 +454,7 @@ Arguments::Arguments(int argc, char **argv) {
     }
 
     // Check to make sure files exist.
-    std::vector<std::string> files;
-    files.push_back(input_reads);
+    std::vector<std::string> files = input_reads;
     for (auto f : short_reads)
         files.push_back(f);
     if (assembly_set)
@@ -332,10 +477,12 @@ Arguments::Arguments(int argc, char **argv) {
     }
 
     // Non-positive target_bases doesn't make sense.
-    if (target_bases_set && target_bases <= 0) {
-        std::cerr << "Error: the value for --target_bases must be a positive integer\n";
-        parsing_result = BAD;
-        return;
+    for (auto value : target_bases_list) {
+        if (value <= 0) {
+            std::cerr << "Error: the value for --target_bases must be a positive integer\n";
+            parsing_result = BAD;
+            return;
+        }
     }
 
     // Non-positive min_length doesn't make sense.
@@ -353,8 +500,33 @@ Arguments::Arguments(int argc, char **argv) {
     }
 
     // keep_percent must be between 0 and 100 (exclusive).
-    if (keep_percent_set && (keep_percent <= 0.0 || keep_percent >= 100.0)) {
-        std::cerr << "Error: the value for --keep_percent must be greater than 0 and less than 100\n";
+    for (auto value : keep_percent_list) {
+        if (value <= 0.0 || value >= 100.0) {
+            std::cerr << "Error: the value for --keep_percent must be greater than 0 and less than 100\n";
+            parsing_result = BAD;
+            return;
+        }
+    }
+
+    // Lists of targets must line up, and each target needs its own output file.
+    if (target_bases_list.size() > 1 && keep_percent_list.size() > 1 &&
+            target_bases_list.size() != keep_percent_list.size()) {
+        std::cerr << "Error: --target_bases and --keep_percent must have the same number of values\n";
+        parsing_result = BAD;
+        return;
+    }
+    if (target_count > 64) {
+        std::cerr << "Error: no more than 64 targets can be used at once\n";
+        parsing_result = BAD;
+        return;
+    }
+    if (target_count > 1 && outputs.size() != target_count) {
+        std::cerr << "Error: with multiple targets, --output must give one file per target\n";
+        parsing_result = BAD;
+        return;
+    }
+    if (target_count == 1 && outputs.size() > 1) {
+        std::cerr << "Error: --output has more files than there are targets\n";
         parsing_result = BAD;
         return;
     }
@@ -391,6 +563,99 @@ Arguments::Arguments(int argc, char **argv) {
         parsing_result = BAD;
         return;
     }
+
+    // Non-positive warm_up doesn't make sense.
+    if (warm_up <= 0) {
+        std::cerr << "Error: the value for --warm_up must be a positive integer\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Streaming decides each read as it goes, against a single estimated threshold.
+    if (streaming && target_count > 1) {
+        std::cerr << "Error: --streaming can only be used with one target\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Streaming doesn't hold on to the scores, so there's nothing to cache.
+    if (streaming && score_cache_set) {
+        std::cerr << "Error: --streaming cannot be used with --score_cache\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Non-positive memory_budget doesn't make sense.
+    if (memory_budget_set && memory_budget <= 0) {
+        std::cerr << "Error: the value for --memory_budget must be a positive integer\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // --memory_budget keeps scores on disk rather than in memory, so it can't list them all (--verbose) or cache them,
+    // and streaming doesn't hold on to them in the first place.
+    if (memory_budget_set && (verbose || score_cache_set || streaming)) {
+        std::cerr << "Error: --memory_budget cannot be used with --verbose, --score_cache or --streaming\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Non-positive threads doesn't make sense.
+    if (threads <= 0) {
+        std::cerr << "Error: the value for --threads must be a positive integer\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // The score table is written from the reads held in memory, which --streaming and --memory_budget don't keep.
+    if (scores_out_set && (streaming || memory_budget_set)) {
+        std::cerr << "Error: --scores_out cannot be used with --streaming or --memory_budget\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (args::get(output_order_arg) != "input" && args::get(output_order_arg) != "score") {
+        std::cerr << "Error: the value for --output_order must be input or score\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // Score order needs every output read's final score before any are written, which --streaming doesn't have and
+    // --memory_budget doesn't keep in memory.
+    if (output_order_score && (streaming || memory_budget_set)) {
+        std::cerr << "Error: --output_order score cannot be used with --streaming or --memory_budget\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (shards <= 0) {
+        std::cerr << "Error: the value for --shards must be a positive integer\n";
+        parsing_result = BAD;
+        return;
+    }
+    if (shards > 1 && outputs.empty()) {
+        std::cerr << "Error: --shards requires --output\n";
+        parsing_result = BAD;
+        return;
+    }
+    if (args::get(shard_by_arg) != "reads" && args::get(shard_by_arg) != "bases") {
+        std::cerr << "Error: the value for --shard_by must be reads or bases\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    // With --streaming, the output's total bases aren't known until the end, so they can't be shared out.
+    if (shard_by_bases && streaming) {
+        std::cerr << "Error: --shard_by bases cannot be used with --streaming\n";
+        parsing_result = BAD;
+        return;
+    }
+
+    if (compression_level < 0 || compression_level > 9) {
+        std::cerr << "Error: the value for --compression_level must be from 0 to 9\n";
+        parsing_result = BAD;
+        return;
+    }
 }
 
 
@@ -398,3 +663,63 @@ bool Arguments::does_file_exist(std::string filename){
     std::ifstream infile(filename);
     return infile.good();
 }
+
+
+// An input path can be a file (used as is), a directory (all read files directly inside it are used, in name order)
+// or a glob pattern (for when the shell didn't expand it, e.g. because it was quoted). Returns false if the path
+// matched nothing.
+bool Arguments::expand_input_path(const std::string & path, std::vector<std::string> & expanded) {
+    struct stat path_stat;
+    if (stat(path.c_str(), &path_stat) == 0) {
+        if (!S_ISDIR(path_stat.st_mode)) {
+            expanded.push_back(path);
+            return true;
+        }
+        DIR * dir = opendir(path.c_str());
+        if (dir == NULL)
+            return false;
+        std::vector<std::string> dir_files;
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string filename = entry->d_name;
+            if (filename.empty() || filename[0] == '.' || !is_read_file_name(filename))
+                continue;
+            std::string file_path = path;
+            if (file_path.back() != '/')
+                file_path += "/";
+            file_path += filename;
+            if (stat(file_path.c_str(), &path_stat) == 0 && S_ISREG(path_stat.st_mode))
+                dir_files.push_back(file_path);
+        }
+        closedir(dir);
+        std::sort(dir_files.begin(), dir_files.end());
+        expanded.insert(expanded.end(), dir_files.begin(), dir_files.end());
+        return !dir_files.empty();
+    }
+
+    if (path.find_first_of("*?[") == std::string::npos)
+        return false;
+    glob_t glob_result;
+    bool matched = (glob(path.c_str(), 0, NULL, &glob_result) == 0);
+    if (matched) {
+        for (size_t i = 0; i < glob_result.gl_pathc; ++i)
+            expanded.push_back(glob_result.gl_pathv[i]);
+    }
+    globfree(&glob_result);
+    return matched;
+}
+
+
+bool Arguments::is_read_file_name(const std::string & filename) {
+    std::string name = filename;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+        name = name.substr(0, name.size() - 3);
+    std::vector<std::string> extensions = {".fastq", ".fq", ".fasta", ".fa", ".fna", ".bam"};
+    for (auto & extension : extensions) {
+        if (name.size() > extension.size() &&
+                name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+            return true;
+    }
+    return false;
+}
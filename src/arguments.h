@@ -47,6 +47,25 @@ struct IntWithSuffixReader
 };
 
 
+// Comma-separated lists, for options which can take one value per target.
+struct IntegerListWithSuffixReader
+{
+    void operator()(const std::string &name, const std::string &value, std::vector<long long> &destination);
+};
+
+
+struct DoublesListReader
+{
+    void operator()(const std::string &name, const std::string &value, std::vector<double> &destination);
+};
+
+
+struct StringListReader
+{
+    void operator()(const std::string &name, const std::string &value, std::vector<std::string> &destination);
+};
+
+
 class Arguments
 {
 public:
@@ -54,13 +73,25 @@ public:
 
     ParsingResult parsing_result;
 
-    std::string input_reads;
+    std::vector<std::string> input_reads;
 
     bool target_bases_set;
     long long target_bases;
+    std::vector<long long> target_bases_list;
 
     bool keep_percent_set;
     double keep_percent;
+    std::vector<double> keep_percent_list;
+
+    // Each target is a --target_bases/--keep_percent pair, with a single value of either applying to every target.
+    size_t target_count;
+    std::vector<std::string> outputs;
+    bool output_order_score;
+    int shards;
+    bool shard_by_bases;
+    bool failed_output_set;
+    std::string failed_output;
+    int compression_level;
 
     bool min_length_set;
     int min_length;
@@ -88,11 +119,29 @@ public:
     int split;
 
     int window_size;
+    int threads;
+    bool io_uring;
+    bool score_cache_set;
+    std::string score_cache;
+    bool streaming;
+    long long warm_up;
+    bool memory_budget_set;
+    long long memory_budget;
+    std::string temp_dir;
+    bool scores_out_set;
+    std::string scores_out;
     bool verbose;
 
+    // Worked out once from the options above: whether anything uses the window quality (if not, reads skip measuring
+    // it) and whether failed reads need all their scores, rather than just what decides they fail.
+    bool window_quality_needed;
+    bool failed_read_scores_needed;
+
 
 private:
     bool does_file_exist(std::string fileName);
+    bool expand_input_path(const std::string & path, std::vector<std::string> & expanded);
+    bool is_read_file_name(const std::string & filename);
 };
 
 #endif // ARGUMENTS_H
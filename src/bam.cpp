@@ -0,0 +1,265 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "bam.h"
+
+#include <cstring>
+#include <sstream>
+#include <zlib.h>
+
+
+static void append_int32(std::vector<unsigned char> & data, int32_t value) {
+    uint32_t v = uint32_t(value);
+    data.push_back(v & 0xff);
+    data.push_back((v >> 8) & 0xff);
+    data.push_back((v >> 16) & 0xff);
+    data.push_back((v >> 24) & 0xff);
+}
+
+
+static void set_uint16(std::vector<unsigned char> & data, size_t i, uint16_t value) {
+    data[i] = value & 0xff;
+    data[i+1] = (value >> 8) & 0xff;
+}
+
+
+// The size of a tag's value, given its type character (and for arrays, the following subtype and count). Returns 0
+// for an unknown type.
+static size_t tag_value_size(const unsigned char * value, const unsigned char * end) {
+    switch (value[-1]) {
+        case 'A': case 'c': case 'C':
+            return 1;
+        case 's': case 'S':
+            return 2;
+        case 'i': case 'I': case 'f':
+            return 4;
+        case 'Z': case 'H': {
+            const unsigned char * p = value;
+            while (p < end && *p != 0)
+                ++p;
+            return size_t(p - value) + 1;
+        }
+        case 'B': {
+            if (end - value < 5)
+                return 0;
+            size_t element_size;
+            switch (value[0]) {
+                case 'c': case 'C': element_size = 1; break;
+                case 's': case 'S': element_size = 2; break;
+                case 'i': case 'I': case 'f': element_size = 4; break;
+                default: return 0;
+            }
+            uint32_t count = uint32_t(value[1]) | (uint32_t(value[2]) << 8) | (uint32_t(value[3]) << 16) |
+                             (uint32_t(value[4]) << 24);
+            return 5 + element_size * count;
+        }
+    }
+    return 0;
+}
+
+
+// Each byte of a BAM sequence holds two bases, high nibble first.
+void BamRecord::decode_sequence(std::vector<char> & bases) const {
+    static const char * nibble_to_base = "=ACMGRSVTWYHKDBN";
+    int n = length();
+    bases.resize(size_t(n) + 1);
+    const unsigned char * packed = sequence();
+    for (int i = 0; i < n; ++i)
+        bases[i] = nibble_to_base[(i % 2 == 0) ? (packed[i / 2] >> 4) : (packed[i / 2] & 0x0f)];
+    bases[n] = '\0';
+}
+
+
+BamReader::BamReader(std::string filename, int threads, bool use_io_uring) :
+    m_bgzf(filename, threads, use_io_uring) {
+}
+
+
+bool BamReader::read_header() {
+    if (!m_bgzf.is_open())
+        return false;
+    char magic[4];
+    if (m_bgzf.read(magic, 4) != 4 || memcmp(magic, "BAM\1", 4) != 0)
+        return false;
+
+    unsigned char int_bytes[4];
+    if (m_bgzf.read(int_bytes, 4) != 4)
+        return false;
+    uint32_t text_length = uint32_t(int_bytes[0]) | (uint32_t(int_bytes[1]) << 8) | (uint32_t(int_bytes[2]) << 16) |
+                           (uint32_t(int_bytes[3]) << 24);
+    m_header_text.resize(text_length);
+    if (m_bgzf.read(&m_header_text[0], text_length) != text_length)
+        return false;
+    m_header_text = m_header_text.c_str();    // the text may be NUL-padded
+
+    // Each reference is a name length, the name and the reference length.
+    if (m_bgzf.read(int_bytes, 4) != 4)
+        return false;
+    m_references.assign(int_bytes, int_bytes + 4);
+    uint32_t reference_count = uint32_t(int_bytes[0]) | (uint32_t(int_bytes[1]) << 8) |
+                               (uint32_t(int_bytes[2]) << 16) | (uint32_t(int_bytes[3]) << 24);
+    for (uint32_t i = 0; i < reference_count; ++i) {
+        if (m_bgzf.read(int_bytes, 4) != 4)
+            return false;
+        uint32_t name_length = uint32_t(int_bytes[0]) | (uint32_t(int_bytes[1]) << 8) |
+                               (uint32_t(int_bytes[2]) << 16) | (uint32_t(int_bytes[3]) << 24);
+        size_t start = m_references.size();
+        m_references.insert(m_references.end(), int_bytes, int_bytes + 4);
+        m_references.resize(start + 4 + name_length + 4);
+        if (m_bgzf.read(m_references.data() + start + 4, name_length + 4) != name_length + 4)
+            return false;
+    }
+    return true;
+}
+
+
+// Returns 1 if a record was read, 0 at the end of the file and -1 if the file is malformed.
+int BamReader::next(BamRecord & record) {
+    record.offset = m_bgzf.tell();
+    unsigned char size_bytes[4];
+    size_t n = m_bgzf.read(size_bytes, 4);
+    if (n == 0 && !m_bgzf.has_error())
+        return 0;
+    if (n != 4)
+        return -1;
+    uint32_t block_size = uint32_t(size_bytes[0]) | (uint32_t(size_bytes[1]) << 8) |
+                          (uint32_t(size_bytes[2]) << 16) | (uint32_t(size_bytes[3]) << 24);
+    if (block_size < 32)
+        return -1;
+    record.data.resize(block_size);
+    if (m_bgzf.read(record.data.data(), block_size) != block_size)
+        return -1;
+
+    // Make sure the variable-length fields fit in the record before anything looks at them.
+    size_t name_length = record.data[8];
+    size_t cigar_length = 4 * size_t(record.data[12] | (record.data[13] << 8));
+    size_t sequence_length = size_t(record.get_int32(16));
+    if (name_length == 0 || int32_t(record.get_int32(16)) < 0 ||
+            32 + name_length + cigar_length + (sequence_length + 1) / 2 + sequence_length > block_size)
+        return -1;
+    record.data[32 + name_length - 1] = 0;
+    return 1;
+}
+
+
+BamWriter::BamWriter(FILE * file, int compression_level, int threads) :
+    m_bgzf(file, compression_level, threads) {
+}
+
+
+void BamWriter::write_header(const std::string & header_text, const std::vector<unsigned char> & references) {
+    std::vector<unsigned char> header = {'B', 'A', 'M', 1};
+    append_int32(header, int32_t(header_text.size()));
+    header.insert(header.end(), header_text.begin(), header_text.end());
+    header.insert(header.end(), references.begin(), references.end());
+    m_bgzf.write(header.data(), header.size());
+}
+
+
+void BamWriter::write_record(const BamRecord & record) {
+    unsigned char size_bytes[4];
+    uint32_t size = uint32_t(record.data.size());
+    for (int i = 0; i < 4; ++i)
+        size_bytes[i] = (size >> (8 * i)) & 0xff;
+    m_bgzf.write(size_bytes, 4);
+    m_bgzf.write(record.data.data(), record.data.size());
+}
+
+
+// A child read is written as an unaligned record holding the parent's bases and qualities in [start, end). Its tags
+// are kept, except for base modification tags (MM/ML) which hold positions in the parent's sequence.
+void BamWriter::write_child_record(const BamRecord & parent, const std::string & name, int start, int end) {
+    int length = end - start;
+    m_record.assign(parent.data.begin(), parent.data.begin() + 32);
+    std::vector<unsigned char> & r = m_record;
+    for (size_t i : {0, 4, 20, 24})
+        memset(r.data() + i, 0xff, 4);     // refID, pos, next_refID, next_pos = -1
+    memset(r.data() + 28, 0, 4);           // tlen = 0
+    r[8] = uint8_t(name.size() + 1);
+    set_uint16(r, 10, 4680);               // bin for an unaligned record
+    set_uint16(r, 12, 0);                  // no CIGAR operations
+    if ((parent.flag() & 4) == 0)
+        set_uint16(r, 14, 4);
+    for (int i = 0; i < 4; ++i)
+        r[16 + i] = (uint32_t(length) >> (8 * i)) & 0xff;
+    r.insert(r.end(), name.begin(), name.end());
+    r.push_back(0);
+
+    const unsigned char * packed = parent.sequence();
+    for (int i = 0; i < length; i += 2) {
+        int j = start + i;
+        unsigned char high = (j % 2 == 0) ? (packed[j / 2] >> 4) : (packed[j / 2] & 0x0f);
+        unsigned char low = 0;
+        if (i + 1 < length) {
+            ++j;
+            low = (j % 2 == 0) ? (packed[j / 2] >> 4) : (packed[j / 2] & 0x0f);
+        }
+        r.push_back(uint8_t((high << 4) | low));
+    }
+    r.insert(r.end(), parent.qualities() + start, parent.qualities() + end);
+
+    const unsigned char * tag = parent.tags();
+    const unsigned char * tags_end = tag + parent.tags_length();
+    while (tag + 3 <= tags_end) {
+        size_t value_size = tag_value_size(tag + 3, tags_end);
+        if (value_size == 0 || tag + 3 + value_size > tags_end)
+            break;
+        bool modification_tag = (tag[0] == 'M' || tag[0] == 'm') && (tag[1] == 'M' || tag[1] == 'm' ||
+                                                                     tag[1] == 'L' || tag[1] == 'l');
+        if (!modification_tag)
+            r.insert(r.end(), tag, tag + 3 + value_size);
+        tag += 3 + value_size;
+    }
+
+    unsigned char size_bytes[4];
+    uint32_t size = uint32_t(r.size());
+    for (int i = 0; i < 4; ++i)
+        size_bytes[i] = (size >> (8 * i)) & 0xff;
+    m_bgzf.write(size_bytes, 4);
+    m_bgzf.write(r.data(), r.size());
+}
+
+
+// Checks the decompressed start of the file for the BAM magic string.
+bool is_bam_file(std::string filename) {
+    gzFile fp = gzopen(filename.c_str(), "r");
+    if (fp == NULL)
+        return false;
+    char magic[4];
+    bool bam = (gzread(fp, magic, 4) == 4 && memcmp(magic, "BAM\1", 4) == 0);
+    gzclose(fp);
+    return bam;
+}
+
+
+// When there are multiple BAM inputs, the output uses the first file's header with any read group lines from the
+// other files added, so the RG tags in their records still refer to something.
+std::string merge_bam_header_text(const std::vector<std::string> & header_texts) {
+    if (header_texts.empty())
+        return "";
+    std::string merged = header_texts[0];
+    if (!merged.empty() && merged.back() != '\n')
+        merged += "\n";
+    for (size_t i = 1; i < header_texts.size(); ++i) {
+        std::istringstream text(header_texts[i]);
+        std::string line;
+        while (std::getline(text, line)) {
+            if (line.compare(0, 3, "@RG") == 0 && merged.find(line + "\n") == std::string::npos)
+                merged += line + "\n";
+        }
+    }
+    return merged;
+}
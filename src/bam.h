@@ -0,0 +1,95 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef BAM_H
+#define BAM_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bgzf.h"
+
+
+// One BAM record, kept in its binary form (everything after the record's block_size field). Filtlong is only
+// interested in unaligned BAM, so the alignment fields are carried along but otherwise ignored.
+struct BamRecord
+{
+    std::vector<unsigned char> data;
+    int64_t offset;    // virtual offset of the record in its file
+
+    const char * name() const {return reinterpret_cast<const char *>(data.data() + 32);}
+    int length() const {return int(get_int32(16));}
+    uint16_t flag() const {return uint16_t(data[14] | (data[15] << 8));}
+    bool is_secondary_or_supplementary() const {return (flag() & 0x900) != 0;}
+
+    // Qualities are raw Phred scores (no +33 offset). A missing quality string is stored as 0xFF bytes.
+    const unsigned char * qualities() const {return sequence() + (length() + 1) / 2;}
+    bool has_qualities() const {return length() > 0 && qualities()[0] != 0xFF;}
+
+    void decode_sequence(std::vector<char> & bases) const;
+
+    const unsigned char * sequence() const {return cigar() + 4 * size_t(data[12] | (data[13] << 8));}
+    const unsigned char * cigar() const {return data.data() + 32 + data[8];}
+    const unsigned char * tags() const {return qualities() + length();}
+    size_t tags_length() const {return data.size() - size_t(tags() - data.data());}
+
+    uint32_t get_int32(size_t i) const {
+        return uint32_t(data[i]) | (uint32_t(data[i+1]) << 8) | (uint32_t(data[i+2]) << 16) |
+               (uint32_t(data[i+3]) << 24);
+    }
+};
+
+
+class BamReader
+{
+public:
+    BamReader(std::string filename, int threads, bool use_io_uring);
+
+    bool read_header();
+    int next(BamRecord & record);
+    bool seek(int64_t offset) {return m_bgzf.seek(offset);}
+
+    std::string m_header_text;
+    std::vector<unsigned char> m_references;    // n_ref and the reference list, stored as is
+
+private:
+    BgzfReader m_bgzf;
+};
+
+
+class BamWriter
+{
+public:
+    BamWriter(FILE * file, int compression_level, int threads);
+
+    void write_header(const std::string & header_text, const std::vector<unsigned char> & references);
+    void write_record(const BamRecord & record);
+    void write_child_record(const BamRecord & parent, const std::string & name, int start, int end);
+    void close() {m_bgzf.close();}
+
+private:
+    BgzfWriter m_bgzf;
+    std::vector<unsigned char> m_record;
+};
+
+
+bool is_bam_file(std::string filename);
+std::string merge_bam_header_text(const std::vector<std::string> & header_texts);
+
+
+#endif // BAM_H
@@ -0,0 +1,304 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "bgzf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#include "task_pool.h"
+
+
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_BLOCK_DATA_SIZE size_t(0xff00)  // how much data we put in each block when writing
+#define BGZF_BLOCKS_PER_THREAD 16           // how many blocks each thread (de)compresses per batch
+
+
+static uint32_t read_uint32(const unsigned char * p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+
+static void write_uint32(unsigned char * p, uint32_t value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+
+BgzfReader::BgzfReader(std::string filename, int threads, bool use_io_uring) :
+    m_file(filename, use_io_uring) {
+    m_threads = std::max(threads, 1);
+    m_error = false;
+    m_end_of_file = false;
+    m_block_index = 0;
+    m_block_offset = 0;
+}
+
+
+// Copies up to length bytes of uncompressed data into the buffer. Returns the number of bytes copied, which is only
+// less than length at the end of the file (or on an error).
+size_t BgzfReader::read(void * buffer, size_t length) {
+    unsigned char * out = static_cast<unsigned char *>(buffer);
+    size_t copied = 0;
+    while (copied < length) {
+        if (m_block_index >= m_blocks.size()) {
+            if (!load_batch())
+                break;
+        }
+        Block & block = m_blocks[m_block_index];
+        size_t available = block.data.size() - m_block_offset;
+        if (available == 0) {
+            ++m_block_index;
+            m_block_offset = 0;
+            continue;
+        }
+        size_t n = std::min(available, length - copied);
+        memcpy(out + copied, block.data.data() + m_block_offset, n);
+        m_block_offset += n;
+        copied += n;
+    }
+    return copied;
+}
+
+
+int64_t BgzfReader::tell() {
+    if (m_block_index < m_blocks.size())
+        return (m_blocks[m_block_index].address << 16) | int64_t(m_block_offset);
+    return int64_t(m_file.tell()) << 16;
+}
+
+
+// Seeking within the current batch of blocks doesn't touch the file. Otherwise the batch is discarded and a new one
+// is loaded from the target block, so any blocks in between are never decompressed.
+bool BgzfReader::seek(int64_t virtual_offset) {
+    int64_t address = virtual_offset >> 16;
+    size_t offset = size_t(virtual_offset & 0xffff);
+    for (size_t i = m_block_index; i < m_blocks.size(); ++i) {
+        if (m_blocks[i].address == address) {
+            if (offset > m_blocks[i].data.size())
+                return false;
+            m_block_index = i;
+            m_block_offset = offset;
+            return true;
+        }
+    }
+    if (!m_file.seek(address))
+        return false;
+    m_blocks.clear();
+    m_block_index = 0;
+    m_block_offset = 0;
+    m_end_of_file = false;
+    if (!load_batch())
+        return offset == 0 && !m_error;
+    if (offset > m_blocks[0].data.size())
+        return false;
+    m_block_offset = offset;
+    return true;
+}
+
+
+// Reads the next batch of compressed blocks from the file and decompresses them, one task per block in the task pool.
+// Returns false if there were no more blocks (or there was an error).
+bool BgzfReader::load_batch() {
+    m_blocks.clear();
+    m_block_index = 0;
+    m_block_offset = 0;
+    if (!m_file.is_open() || m_error || m_end_of_file)
+        return false;
+
+    size_t batch_size = size_t(m_threads) * BGZF_BLOCKS_PER_THREAD;
+    while (m_blocks.size() < batch_size) {
+        Block block;
+        if (!read_compressed_block(block))
+            break;
+        m_blocks.push_back(std::move(block));
+    }
+    if (m_blocks.empty())
+        return false;
+
+    task_pool().run(DECOMPRESSION, m_blocks.size(), [this](size_t i) {inflate_block(m_blocks[i]);});
+
+    for (auto & block : m_blocks) {
+        if (!block.ok) {
+            m_error = true;
+            m_blocks.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool BgzfReader::read_compressed_block(Block & block) {
+    block.address = int64_t(m_file.tell());
+    unsigned char header[12];
+    size_t header_bytes = m_file.read(header, 12);
+    if (header_bytes == 0 && !m_file.has_error()) {
+        m_end_of_file = true;
+        return false;
+    }
+    if (header_bytes < 12 || header[0] != 31 || header[1] != 139 || header[2] != 8 || (header[3] & 4) == 0) {
+        m_error = true;
+        return false;
+    }
+
+    // The block size is stored in the 'BC' subfield of the gzip extra field.
+    size_t extra_length = size_t(header[10]) | (size_t(header[11]) << 8);
+    std::vector<unsigned char> extra(extra_length);
+    if (m_file.read(extra.data(), extra_length) != extra_length) {
+        m_error = true;
+        return false;
+    }
+    size_t block_size = 0;
+    for (size_t i = 0; i + 4 <= extra_length; ) {
+        size_t subfield_length = size_t(extra[i + 2]) | (size_t(extra[i + 3]) << 8);
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && subfield_length == 2 && i + 6 <= extra_length)
+            block_size = (size_t(extra[i + 4]) | (size_t(extra[i + 5]) << 8)) + 1;
+        i += 4 + subfield_length;
+    }
+    if (block_size < 12 + extra_length + 8) {
+        m_error = true;
+        return false;
+    }
+
+    // What's left is the compressed data followed by the CRC and uncompressed size.
+    size_t remaining = block_size - 12 - extra_length;
+    block.compressed.resize(remaining);
+    if (m_file.read(block.compressed.data(), remaining) != remaining) {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+
+void BgzfReader::inflate_block(Block & block) {
+    size_t compressed_size = block.compressed.size() - 8;
+    uint32_t expected_crc = read_uint32(block.compressed.data() + compressed_size);
+    uint32_t data_size = read_uint32(block.compressed.data() + compressed_size + 4);
+    block.ok = false;
+    if (data_size > BGZF_MAX_BLOCK_SIZE)
+        return;
+    block.data.resize(data_size);
+
+    // zlib needs an output pointer even for an empty block (like the end-of-file block).
+    unsigned char empty_output;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -15) != Z_OK)
+        return;
+    stream.next_in = block.compressed.data();
+    stream.avail_in = uInt(compressed_size);
+    stream.next_out = (data_size > 0) ? block.data.data() : &empty_output;
+    stream.avail_out = uInt(data_size);
+    int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END || stream.total_out != data_size)
+        return;
+
+    uint32_t crc = uint32_t(crc32(0L, block.data.data(), uInt(data_size)));
+    block.ok = (crc == expected_crc);
+    std::vector<unsigned char>().swap(block.compressed);
+}
+
+
+BgzfWriter::BgzfWriter(FILE * file, int compression_level, int threads) {
+    m_file = file;
+    m_compression_level = compression_level;
+    m_threads = std::max(threads, 1);
+    m_closed = false;
+    m_blocks.resize(size_t(m_threads) * BGZF_BLOCKS_PER_THREAD);
+    m_block_index = 0;
+}
+
+
+BgzfWriter::~BgzfWriter() {
+    close();
+}
+
+
+void BgzfWriter::write(const void * data, size_t length) {
+    const unsigned char * p = static_cast<const unsigned char *>(data);
+    while (length > 0) {
+        std::vector<unsigned char> & buffer = m_blocks[m_block_index].data;
+        size_t n = std::min(length, BGZF_BLOCK_DATA_SIZE - buffer.size());
+        buffer.insert(buffer.end(), p, p + n);
+        p += n;
+        length -= n;
+        if (buffer.size() == BGZF_BLOCK_DATA_SIZE && ++m_block_index == m_blocks.size())
+            flush_batch(m_blocks.size());
+    }
+}
+
+
+// Flushes any remaining data and writes the end-of-file block. This doesn't close the underlying file.
+void BgzfWriter::close() {
+    if (m_closed)
+        return;
+    size_t block_count = m_block_index;
+    if (block_count < m_blocks.size() && !m_blocks[block_count].data.empty())
+        ++block_count;
+    if (block_count > 0)
+        flush_batch(block_count);
+    static const unsigned char eof_block[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+                                                27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    fwrite(eof_block, 1, 28, m_file);
+    fflush(m_file);
+    m_closed = true;
+}
+
+
+// Compresses the first block_count blocks, one task per block like BgzfReader::load_batch, then writes them to the
+// file in order.
+void BgzfWriter::flush_batch(size_t block_count) {
+    task_pool().run(COMPRESSION, block_count, [this](size_t i) {deflate_block(m_blocks[i], m_compression_level);});
+    for (size_t i = 0; i < block_count; ++i) {
+        fwrite(m_blocks[i].compressed.data(), 1, m_blocks[i].compressed.size(), m_file);
+        m_blocks[i].data.clear();
+    }
+    m_block_index = 0;
+}
+
+
+void BgzfWriter::deflate_block(Block & block, int compression_level) {
+    size_t data_size = block.data.size();
+    const size_t header_size = 18;
+    block.compressed.resize(BGZF_MAX_BLOCK_SIZE);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = block.data.data();
+    stream.avail_in = uInt(data_size);
+    stream.next_out = block.compressed.data() + header_size;
+    stream.avail_out = uInt(block.compressed.size() - header_size - 8);
+    deflate(&stream, Z_FINISH);
+    size_t compressed_size = stream.total_out;
+    deflateEnd(&stream);
+
+    size_t block_size = header_size + compressed_size + 8;
+    static const unsigned char header[16] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0};
+    memcpy(block.compressed.data(), header, 16);
+    block.compressed[16] = (block_size - 1) & 0xff;
+    block.compressed[17] = ((block_size - 1) >> 8) & 0xff;
+    uint32_t crc = uint32_t(crc32(0L, block.data.data(), uInt(data_size)));
+    write_uint32(block.compressed.data() + header_size + compressed_size, crc);
+    write_uint32(block.compressed.data() + header_size + compressed_size + 4, uint32_t(data_size));
+    block.compressed.resize(block_size);
+}
@@ -0,0 +1,103 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef BGZF_H
+#define BGZF_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "input_file.h"
+
+
+// BGZF is the blocked gzip format used by BAM files: a series of independent gzip members, each holding at most 64 kB
+// of data. Because the blocks are independent, they can be decompressed in parallel, and a position in the data can
+// be given as a 'virtual offset': the block's file address in the upper 48 bits and the offset within the block's
+// uncompressed data in the lower 16 bits.
+
+
+// Reads a BGZF file. Blocks are read from disk in batches and each batch is decompressed by multiple threads.
+class BgzfReader
+{
+public:
+    BgzfReader(std::string filename, int threads, bool use_io_uring);
+
+    bool is_open() {return m_file.is_open();}
+    bool has_error() {return m_error;}
+
+    size_t read(void * buffer, size_t length);
+    int64_t tell();
+    bool seek(int64_t virtual_offset);
+
+private:
+    struct Block
+    {
+        int64_t address;
+        std::vector<unsigned char> compressed;
+        std::vector<unsigned char> data;
+        bool ok;
+    };
+
+    InputFile m_file;
+    int m_threads;
+    bool m_error;
+    bool m_end_of_file;
+
+    std::vector<Block> m_blocks;
+    size_t m_block_index;
+    size_t m_block_offset;
+
+    bool load_batch();
+    bool read_compressed_block(Block & block);
+    static void inflate_block(Block & block);
+};
+
+
+// Writes a BGZF file, finishing with the standard empty end-of-file block. Data is gathered into a batch of blocks,
+// each batch is compressed by multiple threads, and the blocks are then written in order. A BGZF file is also a valid
+// gzip file, so this is used for gzipped FASTQ/FASTA output as well as BAM.
+class BgzfWriter
+{
+public:
+    BgzfWriter(FILE * file, int compression_level, int threads);
+    ~BgzfWriter();
+
+    void write(const void * data, size_t length);
+    void close();
+
+private:
+    struct Block
+    {
+        std::vector<unsigned char> data;
+        std::vector<unsigned char> compressed;
+    };
+
+    FILE * m_file;
+    int m_compression_level;
+    int m_threads;
+    bool m_closed;
+
+    std::vector<Block> m_blocks;
+    size_t m_block_index;
+
+    void flush_batch(size_t block_count);
+    static void deflate_block(Block & block, int compression_level);
+};
+
+
+#endif // BGZF_H
@@ -0,0 +1,170 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "fastq_scanner.h"
+
+#include <cctype>
+#include <cstring>
+
+
+#define SCANNER_BUFFER_SIZE 1048576
+
+
+FastqScanner::FastqScanner(std::string filename, bool use_io_uring) :
+    m_file(filename, use_io_uring) {
+    m_buffer.resize(SCANNER_BUFFER_SIZE);
+    m_begin = 0;
+    m_end = 0;
+    m_buffer_offset = 0;
+    m_end_of_file = false;
+    m_error = !m_file.is_open();
+    m_header_char = 0;
+    m_header_offset = 0;
+    m_record_offset = 0;
+}
+
+
+FastqScanner::~FastqScanner() {
+}
+
+
+int FastqScanner::next() {
+    int c;
+
+    // Jump to the next header line, unless the previous call already found it.
+    if (m_header_char == 0) {
+        while ((c = get_char()) >= 0 && c != '>' && c != '@');
+        if (c < 0)
+            return c;
+        m_header_char = c;
+        m_header_offset = m_buffer_offset + (long long)(m_begin) - 1;
+    }
+    m_record_offset = m_header_offset;
+
+    // The name ends at the first whitespace, and the rest of the header line is a comment we don't need.
+    m_name.clear();
+    while ((c = get_char()) >= 0 && !isspace(c))
+        m_name.push_back(char(c));
+    if (c == -3 || (c == -1 && m_name.empty()))
+        return c;
+    size_t length;
+    if (c >= 0 && c != '\n' && read_line(NULL, length) < 0)
+        return -3;
+
+    // Measure the sequence lines without keeping them.
+    size_t seq_length = 0;
+    while ((c = get_char()) >= 0 && c != '>' && c != '+' && c != '@') {
+        if (c == '\n')
+            continue;
+        if (read_line(NULL, length) < 0)
+            return -3;
+        if (!(c == '\r' && length == 0))
+            seq_length += length + 1;
+    }
+    if (c == -3)
+        return -3;
+
+    // Without a '+' line, this was a FASTA record. If it ended at the next header, remember that for the next call.
+    if (c != '+') {
+        m_header_char = (c < 0) ? 0 : c;
+        m_header_offset = m_buffer_offset + (long long)(m_begin) - 1;
+        return -4;
+    }
+    m_header_char = 0;
+
+    // Skip the rest of the '+' line, then gather quality lines until there are as many qualities as bases.
+    int result = read_line(NULL, length);
+    if (result < 0)
+        return -3;
+    if (result == 0)
+        return -2;
+    m_qual.clear();
+    while (m_qual.size() < seq_length) {
+        result = read_line(&m_qual, length);
+        if (result < 0)
+            return -3;
+        if (result == 0)
+            break;
+    }
+    if (m_qual.size() != seq_length)
+        return -2;
+    m_qual.push_back('\0');
+    return int(seq_length);
+}
+
+
+bool FastqScanner::fill_buffer() {
+    if (m_end_of_file || m_error)
+        return false;
+    m_buffer_offset += (long long)(m_end);
+    m_begin = 0;
+    m_end = 0;
+    int n = m_file.read(m_buffer.data(), unsigned(m_buffer.size()));
+    if (n < 0) {
+        m_error = true;
+        return false;
+    }
+    if (n == 0) {
+        m_end_of_file = true;
+        return false;
+    }
+    m_end = size_t(n);
+    return true;
+}
+
+
+int FastqScanner::get_char() {
+    if (m_begin >= m_end && !fill_buffer())
+        return m_error ? -3 : -1;
+    return (unsigned char)(m_buffer[m_begin++]);
+}
+
+
+// Reads up to and including the next newline, appending the line (minus the newline and any trailing CR) to the
+// given vector if there is one. The line's length is set either way. Returns 1 if a newline was found, 0 if the file
+// ended first and -3 on a read error.
+int FastqScanner::read_line(std::vector<char> * line, size_t & length) {
+    length = 0;
+    bool found_newline = false;
+    bool last_cr = false;
+    while (!found_newline) {
+        if (m_begin >= m_end && !fill_buffer()) {
+            if (m_error)
+                return -3;
+            break;
+        }
+        char * start = m_buffer.data() + m_begin;
+        char * newline = static_cast<char *>(memchr(start, '\n', m_end - m_begin));
+        size_t n = (newline != NULL) ? size_t(newline - start) : m_end - m_begin;
+        if (n > 0) {
+            if (line != NULL)
+                line->insert(line->end(), start, start + n);
+            length += n;
+            last_cr = (start[n - 1] == '\r');
+        }
+        m_begin += n;
+        if (newline != NULL) {
+            ++m_begin;
+            found_newline = true;
+        }
+    }
+    if (last_cr) {
+        --length;
+        if (line != NULL)
+            line->pop_back();
+    }
+    return found_newline ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef FASTQ_SCANNER_H
+#define FASTQ_SCANNER_H
+
+
+#include <string>
+#include <vector>
+
+#include "input_file.h"
+
+
+// A FASTQ reader for when only read names, lengths and qualities are needed (scoring without a reference). It
+// follows the same rules as kseq_read (multi-line records, CR/LF line endings, blank lines), but sequence lines are
+// only measured, never copied.
+class FastqScanner
+{
+public:
+    FastqScanner(std::string filename, bool use_io_uring);
+    ~FastqScanner();
+
+    // Return values match kseq_read: >= 0 is the read length, -1 is the end of the file, -2 is a truncated or
+    // mismatched quality string and -3 is a read error. -4 means the record was FASTA, not FASTQ.
+    int next();
+
+    std::string m_name;
+    std::vector<char> m_qual;       // NUL-terminated
+    long long m_record_offset;      // position of the record's '@' in the uncompressed file
+
+private:
+    InputStream m_file;
+    std::vector<char> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    long long m_buffer_offset;      // position of m_buffer[0] in the uncompressed file
+    bool m_end_of_file;
+    bool m_error;
+    int m_header_char;              // a header character already read by the previous call, or 0
+    long long m_header_offset;
+
+    bool fill_buffer();
+    int get_char();
+    int read_line(std::vector<char> * line, size_t & length);
+};
+
+
+#endif // FASTQ_SCANNER_H
@@ -0,0 +1,241 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include "fastx_reader.h"
+
+#include <cctype>
+#include <cstring>
+
+
+#define FASTX_READER_BUFFER_SIZE 65536     // small enough to stay in cache; grows for longer records
+
+
+FastxReader::FastxReader(std::string filename, bool use_io_uring) :
+    m_file(filename, use_io_uring) {
+    m_buffer.resize(FASTX_READER_BUFFER_SIZE);
+    m_begin = 0;
+    m_end = 0;
+    m_cursor = 0;
+    m_end_of_file = false;
+    m_error = !m_file.is_open();
+    m_seq = NULL;
+    m_qual = NULL;
+    m_fastq = false;
+    m_raw = NULL;
+    m_raw_length = 0;
+}
+
+
+FastxReader::~FastxReader() {
+}
+
+
+int FastxReader::next() {
+    m_raw = NULL;
+    m_raw_length = 0;
+
+    // Jump to the next header line. After a FASTA record, it's already at the start of the buffer's data.
+    while (true) {
+        if (!available(0))
+            return m_error ? -3 : -1;
+        char c = at(0);
+        if (c == '>' || c == '@')
+            break;
+        ++m_begin;
+    }
+    int result = next_simple();
+    if (result < 0)
+        result = next_general();
+    return result;
+}
+
+
+// Parses a record in write_fastx_lines's layout where it lies in the buffer. Returns -1 (leaving the buffer's position
+// unchanged) for anything else, which next_general then handles.
+int FastxReader::next_simple() {
+    long long header_end = find_newline(0);
+    if (header_end < 0 || at(size_t(header_end) - 1) == '\r')
+        return -1;
+    size_t name_end = 1;
+    while (name_end < size_t(header_end) && !isspace((unsigned char)(at(name_end))))
+        ++name_end;
+    bool comment = name_end < size_t(header_end);
+    if (comment && (at(name_end) != ' ' || name_end + 1 == size_t(header_end)))
+        return -1;
+
+    size_t seq_start = size_t(header_end) + 1;
+    long long seq_end = find_newline(seq_start);
+    if (seq_end <= (long long)(seq_start) || at(size_t(seq_end) - 1) == '\r')
+        return -1;
+    char first = at(seq_start);
+    if (first == '>' || first == '+' || first == '@')
+        return -1;
+    size_t length = size_t(seq_end) - seq_start;
+    size_t end = size_t(seq_end) + 1;
+
+    bool fastq = available(end) && at(end) == '+';
+    size_t qual_start = 0;
+    if (fastq) {
+        if (!available(end + 1) || at(end + 1) != '\n')
+            return -1;
+        qual_start = end + 2;
+        long long qual_end = find_newline(qual_start);
+        if (qual_end < 0 || size_t(qual_end) - qual_start != length || at(size_t(qual_end) - 1) == '\r')
+            return -1;
+        end = size_t(qual_end) + 1;
+    }
+    else if (m_error || (available(end) && at(end) != '>' && at(end) != '@'))
+        return -1;
+
+    // No more reading from here on, so pointers into the buffer stay valid.
+    const char * record = m_buffer.data() + m_begin;
+    m_name.assign(record + 1, name_end - 1);
+    if (comment)
+        m_comment.assign(record + name_end + 1, size_t(header_end) - name_end - 1);
+    else
+        m_comment.clear();
+    m_seq = record + seq_start;
+    m_qual = fastq ? record + qual_start : NULL;
+    m_fastq = fastq;
+    if (record[0] == (fastq ? '@' : '>')) {
+        m_raw = record;
+        m_raw_length = end;
+    }
+    m_begin += end;
+    return int(length);
+}
+
+
+// Parses a record in any layout, following kseq_read step by step, into m_seq_text and m_qual_text.
+int FastxReader::next_general() {
+    m_cursor = 1;
+    int c = get_char();
+    if (c < 0)
+        return c;
+    m_name.clear();
+    while (c >= 0 && !isspace(c)) {
+        m_name.push_back(char(c));
+        c = get_char();
+    }
+    if (c == -3)
+        return -3;
+    m_comment.clear();
+    if (c != '\n')
+        append_line(m_comment);
+
+    m_seq_text.clear();
+    while ((c = get_char()) >= 0 && c != '>' && c != '+' && c != '@') {
+        if (c == '\n')
+            continue;
+        m_seq_text.push_back(char(c));
+        append_line(m_seq_text);
+    }
+    if (c == -3)
+        return -3;
+    m_fastq = (c == '+');
+    if (c == '>' || c == '@')
+        --m_cursor;        // the next record's header character
+
+    if (m_fastq) {
+        while ((c = get_char()) >= 0 && c != '\n');
+        if (c < 0)
+            return c == -1 ? -2 : c;
+        m_qual_text.clear();
+        int result;
+        while ((result = append_line(m_qual_text)) >= 0 && m_qual_text.size() < m_seq_text.size());
+        if (result == -3)
+            return -3;
+        if (m_qual_text.size() != m_seq_text.size())
+            return -2;
+    }
+    m_seq = m_seq_text.data();
+    m_qual = m_fastq ? m_qual_text.data() : NULL;
+    m_begin += m_cursor;
+    return int(m_seq_text.size());
+}
+
+
+// Adds more of the file to the buffer, moving the current record to the front or growing the buffer if it's full.
+bool FastxReader::read_more() {
+    if (m_end_of_file || m_error)
+        return false;
+    if (m_end == m_buffer.size() && m_begin > 0) {
+        memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_end == m_buffer.size())
+        m_buffer.resize(m_buffer.size() * 2);
+    int n = m_file.read(m_buffer.data() + m_end, unsigned(m_buffer.size() - m_end));
+    if (n < 0)
+        m_error = true;
+    else if (n == 0)
+        m_end_of_file = true;
+    else
+        m_end += size_t(n);
+    return n > 0;
+}
+
+
+// Whether the buffer holds the byte at this position (relative to the current record), reading more if needed.
+bool FastxReader::available(size_t position) {
+    while (m_begin + position >= m_end) {
+        if (!read_more())
+            return false;
+    }
+    return true;
+}
+
+
+// The position (relative to the current record) of the first newline at or after from, reading more as needed, or -1
+// if the file ends first.
+long long FastxReader::find_newline(size_t from) {
+    while (true) {
+        if (m_begin + from < m_end) {
+            const char * start = m_buffer.data() + m_begin + from;
+            const char * newline = static_cast<const char *>(memchr(start, '\n', m_end - m_begin - from));
+            if (newline != NULL)
+                return newline - (m_buffer.data() + m_begin);
+            from = m_end - m_begin;
+        }
+        if (!read_more())
+            return -1;
+    }
+}
+
+
+int FastxReader::get_char() {
+    if (!available(m_cursor))
+        return m_error ? -3 : -1;
+    return (unsigned char)(at(m_cursor++));
+}
+
+
+// Like ks_getuntil2 with KS_SEP_LINE: appends the rest of the line (without its newline) to the text, then drops a
+// trailing CR if the text is longer than one character. Returns the text's length, or -1 if the file had already
+// ended and -3 on a read error.
+int FastxReader::append_line(std::string & text) {
+    long long newline = find_newline(m_cursor);
+    if (m_error)
+        return -3;
+    size_t line_end = (newline >= 0) ? size_t(newline) : m_end - m_begin;
+    if (newline < 0 && line_end == m_cursor)
+        return -1;
+    text.append(m_buffer.data() + m_begin + m_cursor, line_end - m_cursor);
+    m_cursor = (newline >= 0) ? line_end + 1 : line_end;
+    if (text.size() > 1 && text.back() == '\r')
+        text.pop_back();
+    return int(text.size());
+}
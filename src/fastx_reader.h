@@ -0,0 +1,71 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef FASTX_READER_H
+#define FASTX_READER_H
+
+
+#include <string>
+#include <vector>
+
+#include "input_file.h"
+
+
+// A FASTQ/FASTA reader for the output pass. It follows the same rules as kseq_read, but also gives each record's
+// original bytes when they are laid out exactly as write_fastx_lines would write them: a header line with at most a
+// single space before the comment, one sequence line, then for FASTQ a bare '+' line and one quality line, all with
+// LF line endings. Such a record can be copied to the output as it is. Records in this layout are also parsed in place,
+// without copying the sequence or qualities.
+class FastxReader
+{
+public:
+    FastxReader(std::string filename, bool use_io_uring);
+    ~FastxReader();
+
+    // Return values match kseq_read: >= 0 is the read length, -1 is the end of the file, -2 is a truncated or
+    // mismatched quality string and -3 is a read error. The record's pointers are valid until the next call.
+    int next();
+
+    std::string m_name;
+    std::string m_comment;          // empty if the header has no comment
+    const char * m_seq;             // not NUL-terminated
+    const char * m_qual;            // not NUL-terminated, NULL for FASTA
+    bool m_fastq;
+    const char * m_raw;             // the record as it is in the file, or NULL if it isn't in write_fastx_lines's layout
+    size_t m_raw_length;
+
+private:
+    InputStream m_file;
+    std::vector<char> m_buffer;
+    size_t m_begin;                 // the current record's header character
+    size_t m_end;
+    size_t m_cursor;                // for next_general, relative to m_begin
+    bool m_end_of_file;
+    bool m_error;
+    std::string m_seq_text;
+    std::string m_qual_text;
+
+    int next_simple();
+    int next_general();
+    bool read_more();
+    bool available(size_t position);
+    long long find_newline(size_t from);
+    int get_char();
+    int append_line(std::string & text);
+    char at(size_t position) {return m_buffer[m_begin + position];}
+};
+
+
+#endif // FASTX_READER_H
@@ -0,0 +1,541 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "input_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define FILTLONG_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+
+#define INPUT_CHUNK_SIZE 1048576
+#define IO_URING_CHUNKS 8    // how many chunk reads io_uring keeps in flight
+
+
+// The io_uring rings, set up with raw system calls so there's no dependency on liburing. There is one submitter and
+// one reaper (the thread using the InputFile), so the only synchronisation needed is with the kernel: loads of the
+// kernel-written indices are acquire and stores of our indices are release.
+struct IoUring
+{
+#ifdef FILTLONG_IO_URING
+    int fd;
+    bool fixed_buffers;
+    unsigned queued;
+    void * sq_ring;
+    size_t sq_ring_size;
+    void * cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe * sqes;
+    size_t sqes_size;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    io_uring_cqe * cqes;
+    std::vector<struct iovec> iovecs;
+#endif
+};
+
+
+#ifdef FILTLONG_IO_URING
+
+static void close_io_uring(IoUring * ring) {
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    delete ring;
+}
+
+
+static IoUring * open_io_uring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+        return NULL;
+
+    IoUring * ring = new IoUring();
+    ring->fd = fd;
+    ring->fixed_buffers = false;
+    ring->queued = 0;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+        ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap ? ring->sq_ring :
+                    mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_CQ_RING);
+    void * sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED)
+        ring->sq_ring = NULL;
+    if (ring->cq_ring == MAP_FAILED)
+        ring->cq_ring = NULL;
+    ring->sqes = (sqes == MAP_FAILED) ? NULL : static_cast<io_uring_sqe *>(sqes);
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+        close_io_uring(ring);
+        return NULL;
+    }
+
+    char * sq = static_cast<char *>(ring->sq_ring);
+    char * cq = static_cast<char *>(ring->cq_ring);
+    ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return ring;
+}
+
+
+// Registering the buffers saves the kernel from mapping them for every read. It can fail (e.g. on a low locked memory
+// limit), in which case the reads use the buffers unregistered.
+static void register_buffers(IoUring * ring, std::vector<struct iovec> & iovecs) {
+    ring->iovecs = iovecs;
+    ring->fixed_buffers = (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, ring->iovecs.data(),
+                                   unsigned(ring->iovecs.size())) == 0);
+}
+
+
+static void queue_read(IoUring * ring, int fd, unsigned buffer_index, long long offset, size_t length) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    io_uring_sqe * sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)(offset);
+    sqe->user_data = buffer_index;
+    if (ring->fixed_buffers) {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (unsigned long long)(ring->iovecs[buffer_index].iov_base);
+        sqe->len = unsigned(length);
+        sqe->buf_index = (unsigned short)(buffer_index);
+    }
+    else {
+        ring->iovecs[buffer_index].iov_len = length;
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (unsigned long long)(&ring->iovecs[buffer_index]);
+        sqe->len = 1;
+    }
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->queued;
+}
+
+
+// Submits any queued reads and, if wait is set, blocks until at least one read has completed.
+static bool enter_io_uring(IoUring * ring, bool wait) {
+    while (true) {
+        long result = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait ? 1 : 0,
+                              wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (result >= 0) {
+            ring->queued -= std::min(ring->queued, unsigned(result));
+            if (ring->queued == 0)
+                return true;
+        }
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return false;
+    }
+}
+
+#endif // FILTLONG_IO_URING
+
+
+bool InputFile::io_uring_available() {
+#ifdef FILTLONG_IO_URING
+    IoUring * ring = open_io_uring(1);
+    if (ring == NULL)
+        return false;
+    close_io_uring(ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+InputFile::InputFile(std::string filename, bool use_io_uring) {
+    m_fd = open(filename.c_str(), O_RDONLY);
+    m_error = false;
+    m_file_size = -1;
+    m_memory = NULL;
+    m_current = 0;
+    m_position = 0;
+    m_next_offset = 0;
+    m_ring = NULL;
+    if (m_fd < 0)
+        return;
+
+    // Only regular files can be read at arbitrary offsets. Anything else (e.g. a pipe) is read in order with read().
+    struct stat file_stat;
+    if (fstat(m_fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+        m_file_size = (long long)(file_stat.st_size);
+
+#ifdef FILTLONG_IO_URING
+    if (use_io_uring && m_file_size >= 0)
+        m_ring = open_io_uring(IO_URING_CHUNKS);
+#else
+    (void)use_io_uring;
+#endif
+
+    size_t chunk_count = (m_ring != NULL) ? IO_URING_CHUNKS : 1;
+    void * memory = NULL;
+    if (posix_memalign(&memory, 4096, chunk_count * INPUT_CHUNK_SIZE) != 0) {
+        m_error = true;
+        return;
+    }
+    m_memory = static_cast<unsigned char *>(memory);
+    m_chunks.resize(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        m_chunks[i].data = m_memory + i * INPUT_CHUNK_SIZE;
+        m_chunks[i].offset = 0;
+        m_chunks[i].length = 0;
+        m_chunks[i].pending = false;
+    }
+
+#ifdef FILTLONG_IO_URING
+    if (m_ring != NULL) {
+        std::vector<struct iovec> iovecs(chunk_count);
+        for (size_t i = 0; i < chunk_count; ++i) {
+            iovecs[i].iov_base = m_chunks[i].data;
+            iovecs[i].iov_len = INPUT_CHUNK_SIZE;
+        }
+        register_buffers(m_ring, iovecs);
+    }
+#endif
+    restart(0);
+}
+
+
+InputFile::~InputFile() {
+    // The kernel may still be writing into the buffers, so those reads have to finish before the buffers are freed.
+    for (auto & chunk : m_chunks)
+        wait_for(chunk);
+#ifdef FILTLONG_IO_URING
+    if (m_ring != NULL)
+        close_io_uring(m_ring);
+#endif
+    free(m_memory);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+
+// Copies up to length bytes into the buffer. Returns the number of bytes copied, which is only less than length at
+// the end of the file (or on an error).
+size_t InputFile::read(void * buffer, size_t length) {
+    unsigned char * out = static_cast<unsigned char *>(buffer);
+    size_t copied = 0;
+    while (copied < length) {
+        size_t available;
+        const unsigned char * data = next_data(available);
+        if (data == NULL)
+            break;
+        size_t n = std::min(available, length - copied);
+        memcpy(out + copied, data, n);
+        copied += n;
+        m_position -= available - n;    // give back what we didn't use
+    }
+    return copied;
+}
+
+
+// Returns the rest of the current chunk (moving to the next chunk first if this one is used up) without copying it.
+// The data stays valid until the next call to read, next_data or seek. Returns NULL at the end of the file.
+const unsigned char * InputFile::next_data(size_t & length) {
+    length = 0;
+    if (m_chunks.empty())
+        return NULL;
+    while (true) {
+        Chunk & chunk = m_chunks[m_current];
+        if (!wait_for(chunk))
+            return NULL;
+        if (m_position < chunk.length) {
+            length = chunk.length - m_position;
+            const unsigned char * data = chunk.data + m_position;
+            m_position = chunk.length;
+            return data;
+        }
+        if (chunk.length == 0)
+            return NULL;
+        next_chunk();
+    }
+}
+
+
+long long InputFile::tell() {
+    if (m_chunks.empty())
+        return 0;
+    return m_chunks[m_current].offset + (long long)(m_position);
+}
+
+
+// A seek forward into a chunk which has already been requested uses that read. Otherwise the reads in flight are
+// dropped and new ones are started from the target.
+bool InputFile::seek(long long offset) {
+    if (m_chunks.empty())
+        return false;
+    long long first = m_chunks[m_current].offset;
+    if (offset >= first && offset < first + (long long)(m_chunks.size() * INPUT_CHUNK_SIZE)) {
+        size_t steps = size_t((offset - first) / INPUT_CHUNK_SIZE);
+        for (size_t i = 0; i < steps; ++i)
+            next_chunk();
+        Chunk & chunk = m_chunks[m_current];
+        if (!wait_for(chunk))
+            return false;
+        if (offset - chunk.offset <= (long long)(chunk.length)) {
+            m_position = size_t(offset - chunk.offset);
+            return true;
+        }
+    }
+    if (m_file_size < 0)
+        return false;
+    restart(offset);
+    return true;
+}
+
+
+// Requests the data after the last requested chunk into this chunk. With io_uring the read is only queued; otherwise
+// it happens now.
+void InputFile::request(Chunk & chunk) {
+    chunk.offset = m_next_offset;
+    chunk.length = INPUT_CHUNK_SIZE;
+    chunk.pending = false;
+    if (m_file_size >= 0)
+        chunk.length = size_t(std::max(0LL, std::min((long long)(INPUT_CHUNK_SIZE), m_file_size - chunk.offset)));
+    if (chunk.length == 0 || m_error)
+        return;
+
+#ifdef FILTLONG_IO_URING
+    if (m_ring != NULL) {
+        queue_read(m_ring, m_fd, unsigned(&chunk - m_chunks.data()), chunk.offset, chunk.length);
+        chunk.pending = true;
+        m_next_offset += (long long)(chunk.length);
+        return;
+    }
+#endif
+    if (m_file_size >= 0) {
+        finish_with_pread(chunk, 0);
+    }
+    else {
+        ssize_t n;
+        do {
+            n = ::read(m_fd, chunk.data, INPUT_CHUNK_SIZE);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            m_error = true;
+        chunk.length = (n > 0) ? size_t(n) : 0;
+    }
+    m_next_offset += (long long)(chunk.length);
+}
+
+
+// Blocks until the chunk's read has completed, handling any other completions which arrive first. Returns false on an
+// error.
+bool InputFile::wait_for(Chunk & chunk) {
+#ifdef FILTLONG_IO_URING
+    while (chunk.pending) {
+        unsigned head = *m_ring->cq_head;
+        unsigned tail = __atomic_load_n(m_ring->cq_tail, __ATOMIC_ACQUIRE);
+        for ( ; head != tail; ++head) {
+            io_uring_cqe * cqe = &m_ring->cqes[head & *m_ring->cq_mask];
+            Chunk & done = m_chunks[size_t(cqe->user_data)];
+            done.pending = false;
+
+            // A short read (or an interrupted one) is finished off with pread, so every chunk is full unless it's the
+            // last one.
+            if (cqe->res < 0 && cqe->res != -EINTR && cqe->res != -EAGAIN) {
+                m_error = true;
+                done.length = 0;
+            }
+            else if (size_t(std::max(cqe->res, 0)) < done.length) {
+                finish_with_pread(done, size_t(std::max(cqe->res, 0)));
+            }
+        }
+        __atomic_store_n(m_ring->cq_head, head, __ATOMIC_RELEASE);
+        if (chunk.pending && !enter_io_uring(m_ring, true)) {
+            m_error = true;
+            break;
+        }
+    }
+#endif
+    return !m_error;
+}
+
+
+void InputFile::finish_with_pread(Chunk & chunk, size_t done) {
+    while (done < chunk.length) {
+        ssize_t n = pread(m_fd, chunk.data + done, chunk.length - done, off_t(chunk.offset + (long long)(done)));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            m_error = true;
+        if (n <= 0)
+            break;
+        done += size_t(n);
+    }
+    chunk.length = done;
+}
+
+
+// The current chunk is finished with, so it's reused for the next read in line.
+void InputFile::next_chunk() {
+    Chunk & done = m_chunks[m_current];
+    wait_for(done);
+    request(done);
+#ifdef FILTLONG_IO_URING
+    if (m_ring != NULL && !enter_io_uring(m_ring, false))
+        m_error = true;
+#endif
+    m_current = (m_current + 1) % m_chunks.size();
+    m_position = 0;
+}
+
+
+void InputFile::restart(long long offset) {
+    for (auto & chunk : m_chunks)
+        wait_for(chunk);
+    m_next_offset = offset;
+    for (auto & chunk : m_chunks)
+        request(chunk);
+#ifdef FILTLONG_IO_URING
+    if (m_ring != NULL && !enter_io_uring(m_ring, false))
+        m_error = true;
+#endif
+    m_current = 0;
+    m_position = 0;
+}
+
+
+InputStream::InputStream(std::string filename, bool use_io_uring) :
+    m_file(filename, use_io_uring) {
+    memset(&m_stream, 0, sizeof(m_stream));
+    m_started = false;
+    m_gzip = false;
+    m_member_ended = false;
+    m_end_of_file = false;
+    m_error = !m_file.is_open();
+    m_input = NULL;
+    m_input_length = 0;
+}
+
+
+InputStream::~InputStream() {
+    if (m_gzip)
+        inflateEnd(&m_stream);
+}
+
+
+bool InputStream::fill_input() {
+    m_input = m_file.next_data(m_input_length);
+    if (m_file.has_error())
+        m_error = true;
+    return m_input != NULL;
+}
+
+
+int InputStream::read(void * buffer, unsigned length) {
+    if (m_error)
+        return -1;
+
+    // The gzip magic bytes at the start of the file decide whether it's decompressed.
+    if (!m_started) {
+        m_started = true;
+        if (fill_input() && m_input_length >= 2 && m_input[0] == 0x1f && m_input[1] == 0x8b) {
+            m_gzip = true;
+            if (inflateInit2(&m_stream, 15 + 16) != Z_OK)
+                m_error = true;
+        }
+        if (m_error)
+            return -1;
+    }
+
+    unsigned char * out = static_cast<unsigned char *>(buffer);
+    unsigned produced = 0;
+    while (produced < length && !m_end_of_file) {
+        if (m_input_length == 0 && !fill_input()) {
+            if (m_error || (m_gzip && !m_member_ended))
+                return -1;    // a read error or a truncated gzip file
+            m_end_of_file = true;
+            break;
+        }
+        if (!m_gzip) {
+            unsigned n = unsigned(std::min(size_t(length - produced), m_input_length));
+            memcpy(out + produced, m_input, n);
+            m_input += n;
+            m_input_length -= n;
+            produced += n;
+            continue;
+        }
+
+        // After one gzip member, another may follow. Anything else after a member is ignored, as gzread does.
+        if (m_member_ended) {
+            if (m_input[0] != 0x1f) {
+                m_end_of_file = true;
+                break;
+            }
+            inflateReset(&m_stream);
+            m_member_ended = false;
+        }
+        m_stream.next_in = const_cast<unsigned char *>(m_input);
+        m_stream.avail_in = uInt(m_input_length);
+        m_stream.next_out = out + produced;
+        m_stream.avail_out = length - produced;
+        int result = inflate(&m_stream, Z_NO_FLUSH);
+        produced = length - m_stream.avail_out;
+        m_input = m_stream.next_in;
+        m_input_length = m_stream.avail_in;
+        if (result == Z_STREAM_END)
+            m_member_ended = true;
+        else if (result != Z_OK && result != Z_BUF_ERROR) {
+            m_error = true;
+            return -1;
+        }
+    }
+    return int(produced);
+}
+
+
+int input_stream_read(InputStream * stream, void * buffer, unsigned length) {
+    return stream->read(buffer, length);
+}
@@ -0,0 +1,106 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+
+struct IoUring;
+
+
+// Reads a file's bytes in large chunks. With io_uring (Linux only), several chunks are kept in flight at once, using
+// buffers registered with the kernel, so the next chunks are usually already loaded by the time they are needed.
+// Without io_uring (not asked for or not available), each chunk is read with pread when it is needed.
+class InputFile
+{
+public:
+    InputFile(std::string filename, bool use_io_uring);
+    ~InputFile();
+
+    bool is_open() {return m_fd >= 0;}
+    bool has_error() {return m_error;}
+    bool using_io_uring() {return m_ring != NULL;}
+
+    size_t read(void * buffer, size_t length);
+    const unsigned char * next_data(size_t & length);
+    long long tell();
+    bool seek(long long offset);
+
+    static bool io_uring_available();
+
+private:
+    struct Chunk
+    {
+        unsigned char * data;
+        long long offset;
+        size_t length;
+        bool pending;
+    };
+
+    int m_fd;
+    bool m_error;
+    long long m_file_size;
+    unsigned char * m_memory;
+    std::vector<Chunk> m_chunks;    // a ring of chunks, in file order from m_current
+    size_t m_current;
+    size_t m_position;              // how much of the current chunk has been used
+    long long m_next_offset;        // where the next chunk to be requested starts
+    IoUring * m_ring;
+
+    void request(Chunk & chunk);
+    bool wait_for(Chunk & chunk);
+    void finish_with_pread(Chunk & chunk, size_t done);
+    void next_chunk();
+    void restart(long long offset);
+};
+
+
+// Gives the decompressed contents of a file (gzipped or not) through an InputFile, for kseq and the FASTQ scanner. Like
+// gzread, concatenated gzip members are read as one stream.
+class InputStream
+{
+public:
+    InputStream(std::string filename, bool use_io_uring);
+    ~InputStream();
+
+    bool is_open() {return m_file.is_open();}
+    int read(void * buffer, unsigned length);
+    long long tell() {return m_file.tell() - (long long)(m_input_length);}   // in the file's (compressed) bytes
+
+private:
+    InputFile m_file;
+    z_stream m_stream;
+    bool m_started;
+    bool m_gzip;
+    bool m_member_ended;
+    bool m_end_of_file;
+    bool m_error;
+    const unsigned char * m_input;
+    size_t m_input_length;
+
+    bool fill_input();
+};
+
+
+// Returns the same values as gzread: the number of bytes read, 0 at the end of the file and -1 on an error.
+int input_stream_read(InputStream * stream, void * buffer, unsigned length);
+
+
+#endif // INPUT_FILE_H
@@ -16,29 +16,25 @@
 
 #include "kmers.h"
 
+#include <algorithm>
 #include <iostream>
 #include <zlib.h>
 #include <stdio.h>
 #include "kseq.h"
 #include "misc.h"
+#include "task_pool.h"
+
+#define REFERENCE_BATCH_BASES 4000000    // reference sequences are hashed in batches of about this many bases
 
 KSEQ_INIT(gzFile, gzread)
 
 
 Kmers::Kmers() {
-    bloom_parameters parameters;
-
-    // TO DO: it might be worth experimenting with these values to see how it affects time and memory usage.
-    parameters.projected_element_count = 100000000;
-    parameters.false_positive_probability = 0.0001; // 1 in 10000
-    parameters.random_seed = 0xA5A5A5A5;
-
-    parameters.compute_optimal_parameters();
-
-    //Instantiate Bloom Filter
-    bloom = new bloom_filter(parameters);
-
+    bloom = NULL;
     required_kmer_copies = 4;
+    m_kmers.resize(1);
+    m_kmer_count = 0;
+    m_shard_shift = 32;
 }
 
 
@@ -50,43 +46,107 @@ Kmers::~Kmers() {
 void Kmers::add_read_fastqs(std::vector<std::string> filenames) {
     std::cerr << "Hashing 16-mers from short reads\n";
 
+    // The bloom filter is only needed for counting short read k-mers, and it's large, so it's made here rather than
+    // along with the Kmers object.
+    if (bloom == NULL) {
+        bloom_parameters parameters;
+
+        // TO DO: it might be worth experimenting with these values to see how it affects time and memory usage.
+        parameters.projected_element_count = 100000000;
+        parameters.false_positive_probability = 0.0001; // 1 in 10000
+        parameters.random_seed = 0xA5A5A5A5;
+
+        parameters.compute_optimal_parameters();
+        bloom = new bloom_filter(parameters);
+    }
+
     int sequence_count = 0;
     for (auto & filename : filenames)
-        sequence_count += add_reference(filename, true);
+        sequence_count += add_reference<true>(filename);
     std::cerr << "  " << int_to_string(sequence_count) << " reads, "
-              << int_to_string(m_kmers.size()) << " 16-mers\n\n";
+              << int_to_string(m_kmer_count) << " 16-mers\n\n";
 }
 
 
 void Kmers::add_assembly_fasta(std::string filename) {
     std::cerr << "Hashing 16-mers from assembly\n";
     std::cerr << "  " << filename << "\n";
-    int sequence_count = add_reference(filename, false);
+
+    // Sharding lets the assembly's k-mers be added in parallel, but it costs a little with only one thread.
+    if (m_kmer_count == 0 && task_pool().threads() > 1) {
+        m_kmers.assign(size_t(1) << KMER_SHARD_BITS, std::unordered_set<uint32_t>());
+        m_shard_shift = 32 - KMER_SHARD_BITS;
+    }
+    int sequence_count = add_reference<false>(filename);
     std::string noun;
     if (sequence_count == 1)
         noun = "contig";
     else
         noun = "contigs";
     std::cerr << "  " << int_to_string(sequence_count) << " " << noun << ", "
-              << int_to_string(m_kmers.size()) << " 16-mers\n\n";
+              << int_to_string(m_kmer_count) << " 16-mers\n\n";
 }
 
 
-int Kmers::add_reference(std::string filename, bool require_two_kmer_copies) {
-    int l;
-    uint32_t forward_kmer, reverse_kmer;
-    int sequence_count = 0;
+// Calls add on both strands' 16-mers at each position of the sequence.
+template <typename Add>
+static void for_each_kmer(const std::string & sequence, Add add) {
+    uint32_t forward_kmer = Kmers::starting_kmer_to_bits_forward(sequence.data());
+    uint32_t reverse_kmer = Kmers::starting_kmer_to_bits_reverse(sequence.data());
+    add(forward_kmer);
+    add(reverse_kmer);
+    for (size_t i = 16; i < sequence.size(); ++i) {
+        forward_kmer <<= 2;
+        forward_kmer |= Kmers::base_to_bits_forward(sequence[i]);
 
-    // We'll use a different k-mer adding function for assembly hashing and read hashing.
-    void (Kmers::*add_kmer)(uint32_t);
-    if (require_two_kmer_copies)
-        add_kmer = &Kmers::add_kmer_require_multiple_copies;
-    else
-        add_kmer = &Kmers::add_kmer_require_one_copy;
+        reverse_kmer >>= 2;
+        reverse_kmer |= Kmers::base_to_bits_reverse(sequence[i]);
 
+        add(forward_kmer);
+        add(reverse_kmer);
+    }
+}
+
+
+// Assembly hashing and read hashing add k-mers differently, so each has its own instantiation of this function, with
+// the k-mer adding code called directly (and inlined) in the loop. Sequences are read in batches, and each batch is
+// hashed by tasks in the task pool while the next one is read. For an assembly, each task adds the k-mers of some of
+// the set's shards, so the tasks can run in parallel. Short read k-mers go through the bloom filter and counts in order,
+// so each batch is a single task.
+template <bool RequireMultipleCopies>
+int Kmers::add_reference(std::string filename) {
+    int l;
+    int sequence_count = 0;
     long long base_count = 0;
     long long last_progress = 0;
 
+    TaskGroup group;
+    std::vector<std::string> batch, hashing;
+    long long batch_bases = 0;
+    size_t shard_count = m_kmers.size();
+    size_t tasks = RequireMultipleCopies ? 1 : std::min(size_t(task_pool().threads()), shard_count);
+    auto hash_batch = [&]() {
+        task_pool().wait(group);
+        hashing.swap(batch);
+        batch.clear();
+        batch_bases = 0;
+        for (size_t t = 0; t < tasks; ++t) {
+            task_pool().submit(group, REFERENCE_HASHING, [this, &hashing, t, tasks, shard_count]() {
+                size_t first_shard = t * shard_count / tasks, last_shard = (t + 1) * shard_count / tasks;
+                for (auto & sequence : hashing) {
+                    if (RequireMultipleCopies)
+                        for_each_kmer(sequence, [this](uint32_t kmer) {add_kmer_require_multiple_copies(kmer);});
+                    else
+                        for_each_kmer(sequence, [&](uint32_t kmer) {
+                            size_t shard = shard_of(kmer);
+                            if (shard >= first_shard && shard < last_shard)
+                                m_kmers[shard].insert(kmer);
+                        });
+                }
+            });
+        }
+    };
+
     gzFile fp = gzopen(filename.c_str(), "r");
     kseq_t * seq = kseq_init(fp);
     while ((l = kseq_read(seq)) >= 0) {
@@ -100,25 +160,10 @@ int Kmers::add_reference(std::string filename, bool require_two_kmer_copies) {
                 continue;
 
             base_count += seq->seq.l;
-            char * sequence = seq->seq.s;
-
-            // Build the starting k-mers from the first 16 bases.
-            forward_kmer = starting_kmer_to_bits_forward(sequence);
-            reverse_kmer = starting_kmer_to_bits_reverse(sequence);
-
-            (this->*add_kmer)(forward_kmer);
-            (this->*add_kmer)(reverse_kmer);
-
-            for (size_t i = 16; i < seq->seq.l; ++i) {
-                forward_kmer <<= 2;
-                forward_kmer |= base_to_bits_forward(sequence[i]);
-
-                reverse_kmer >>= 2;
-                reverse_kmer |= base_to_bits_reverse(sequence[i]);
-
-                (this->*add_kmer)(forward_kmer);
-                (this->*add_kmer)(reverse_kmer);
-            }
+            batch_bases += seq->seq.l;
+            batch.push_back(std::string(seq->seq.s, seq->seq.l));
+            if (batch_bases >= REFERENCE_BATCH_BASES)
+                hash_batch();
 
             if (base_count - last_progress >= 483611) {  // a big prime number so progress updates don't round off
                 last_progress = base_count;
@@ -126,22 +171,24 @@ int Kmers::add_reference(std::string filename, bool require_two_kmer_copies) {
             }
         }
     }
+    if (!batch.empty())
+        hash_batch();
+    task_pool().wait(group);
     kseq_destroy(seq);
     gzclose(fp);
+
+    m_kmer_count = 0;
+    for (auto & shard : m_kmers)
+        m_kmer_count += shard.size();
     print_hash_progress(filename, base_count);
     std::cerr << "\n";
     return sequence_count;
 }
 
 
-void Kmers::add_kmer_require_one_copy(uint32_t kmer) {
-    m_kmers.insert(kmer);
-}
-
-
 void Kmers::add_kmer_require_multiple_copies(uint32_t kmer) {
     // If the kmer is already in the final set, then we can skip the rest of this function.
-    if (m_kmers.find(kmer) != m_kmers.end())
+    if (is_kmer_present(kmer))
         return;
 
     // Check the bloom filter. If it's not in there, this is definitely the first time it's been seen.
@@ -159,81 +206,8 @@ void Kmers::add_kmer_require_multiple_copies(uint32_t kmer) {
     else {
         int times_seen = ++m_kmer_counts[kmer];
         if (times_seen >= required_kmer_copies) {
-            m_kmers.insert(kmer);
+            m_kmers[shard_of(kmer)].insert(kmer);
             m_kmer_counts.erase(kmer);
         }
     }
 }
-
-
-
-bool Kmers::is_kmer_present(uint32_t kmer) {
-    return m_kmers.find(kmer) != m_kmers.end();
-}
-
-
-
-uint32_t Kmers::base_to_bits_forward(char base) {
-    switch (base) {
-        case 'A':
-            return 0;  // 00000000000000000000000000000000
-        case 'C':
-            return 1;  // 00000000000000000000000000000001
-        case 'G':
-            return 2;  // 00000000000000000000000000000010
-        case 'T':
-            return 3;  // 00000000000000000000000000000011
-        case 'a':
-            return 0;
-        case 'c':
-            return 1;
-        case 'g':
-            return 2;
-        case 't':
-            return 3;
-    }
-    return 0;
-}
-
-
-uint32_t Kmers::base_to_bits_reverse(char base) {
-    switch (base) {
-        case 'T':
-            return 0;           // 00000000000000000000000000000000
-        case 'G':
-            return 1073741824;  // 01000000000000000000000000000000
-        case 'C':
-            return 2147483648;  // 10000000000000000000000000000000
-        case 'A':
-            return 3221225472;  // 11000000000000000000000000000000
-        case 't':
-            return 0;
-        case 'g':
-            return 1073741824;
-        case 'c':
-            return 2147483648;
-        case 'a':
-            return 3221225472;
-    }
-    return 0;
-}
-
-
-uint32_t Kmers::starting_kmer_to_bits_forward(char * sequence) {
-    uint32_t kmer = 0;
-    for (int i = 0; i < 16; ++i) {
-        kmer <<= 2;
-        kmer |= base_to_bits_forward(sequence[i]);
-    }
-    return kmer;
-}
-
-
-uint32_t Kmers::starting_kmer_to_bits_reverse(char * sequence) {
-    uint32_t kmer = 0;
-    for (int i = 0; i < 16; ++i) {
-        kmer >>= 2;
-        kmer |= base_to_bits_reverse(sequence[i]);
-    }
-    return kmer;
-}
@@ -25,34 +25,109 @@
 #include "bloom_filter.h"
 
 
+#define KMER_SHARD_BITS 6    // with more than one thread, the k-mer set is split into 64 shards, hashed in parallel
+
+
 class Kmers
 {
 public:
     Kmers();
     ~Kmers();
 
-    bool empty() {return m_kmers.size() == 0;}
+    bool empty() {return m_kmer_count == 0;}
 
     void add_read_fastqs(std::vector<std::string> filenames);
     void add_assembly_fasta(std::string filename);
-    bool is_kmer_present(uint32_t kmer);
 
-    uint32_t starting_kmer_to_bits_forward(char * sequence);
-    uint32_t starting_kmer_to_bits_reverse(char * sequence);
+    // These are used for every base of every read, so they're defined here where they can be inlined.
+    bool is_kmer_present(uint32_t kmer) {
+        const std::unordered_set<uint32_t> & shard = m_kmers[shard_of(kmer)];
+        return shard.find(kmer) != shard.end();
+    }
+    size_t shard_of(uint32_t kmer) {return uint64_t(uint32_t(kmer * uint32_t(2654435761))) >> m_shard_shift;}
+    static uint32_t base_to_bits_forward(char base);
+    static uint32_t base_to_bits_reverse(char base);
 
-    uint32_t base_to_bits_forward(char base);
-    uint32_t base_to_bits_reverse(char base);
+    static uint32_t starting_kmer_to_bits_forward(const char * sequence);
+    static uint32_t starting_kmer_to_bits_reverse(const char * sequence);
 
 private:
-    std::unordered_set<uint32_t> m_kmers;
+    std::vector<std::unordered_set<uint32_t>> m_kmers;    // one set per shard
+    size_t m_kmer_count;
+    int m_shard_shift;    // 32 when the set is a single shard
     std::unordered_map<uint32_t, int> m_kmer_counts;
-    bloom_filter * bloom;
+    bloom_filter * bloom;    // only made for short read references
     int required_kmer_copies;
 
-    int add_reference(std::string filename, bool require_two_kmer_copies);
-    void add_kmer_require_one_copy(uint32_t kmer);
+    template <bool RequireMultipleCopies> int add_reference(std::string filename);
     void add_kmer_require_multiple_copies(uint32_t kmer);
 };
 
 
+inline uint32_t Kmers::base_to_bits_forward(char base) {
+    switch (base) {
+        case 'A':
+            return 0;  // 00000000000000000000000000000000
+        case 'C':
+            return 1;  // 00000000000000000000000000000001
+        case 'G':
+            return 2;  // 00000000000000000000000000000010
+        case 'T':
+            return 3;  // 00000000000000000000000000000011
+        case 'a':
+            return 0;
+        case 'c':
+            return 1;
+        case 'g':
+            return 2;
+        case 't':
+            return 3;
+    }
+    return 0;
+}
+
+
+inline uint32_t Kmers::base_to_bits_reverse(char base) {
+    switch (base) {
+        case 'T':
+            return 0;           // 00000000000000000000000000000000
+        case 'G':
+            return 1073741824;  // 01000000000000000000000000000000
+        case 'C':
+            return 2147483648;  // 10000000000000000000000000000000
+        case 'A':
+            return 3221225472;  // 11000000000000000000000000000000
+        case 't':
+            return 0;
+        case 'g':
+            return 1073741824;
+        case 'c':
+            return 2147483648;
+        case 'a':
+            return 3221225472;
+    }
+    return 0;
+}
+
+
+inline uint32_t Kmers::starting_kmer_to_bits_forward(const char * sequence) {
+    uint32_t kmer = 0;
+    for (int i = 0; i < 16; ++i) {
+        kmer <<= 2;
+        kmer |= base_to_bits_forward(sequence[i]);
+    }
+    return kmer;
+}
+
+
+inline uint32_t Kmers::starting_kmer_to_bits_reverse(const char * sequence) {
+    uint32_t kmer = 0;
+    for (int i = 0; i < 16; ++i) {
+        kmer >>= 2;
+        kmer |= base_to_bits_reverse(sequence[i]);
+    }
+    return kmer;
+}
+
+
 #endif // KMERS_H
@@ -15,6 +15,8 @@
 
 
 #include <iostream>
+#include <sstream>
+#include <unistd.h>
 #include <zlib.h>
 #include <stdio.h>
 #include <vector>
@@ -22,16 +24,1061 @@
 #include <unordered_map>
 #include <utility>
 #include <math.h>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <sys/stat.h>
 
 #include "kseq.h"
 #include "read.h"
 #include "arguments.h"
 #include "kmers.h"
 #include "misc.h"
+#include "bam.h"
+#include "fastq_scanner.h"
+#include "fastx_reader.h"
+#include "input_file.h"
+#include "scored_input.h"
+#include "score_cache.h"
+#include "selection.h"
+#include "quality_stats.h"
+#include "quantile_sketch.h"
+#include "spill_file.h"
+#include "output_writer.h"
+#include "score_table.h"
+#include "score_order.h"
+#include "task_pool.h"
 
 #define PROGRAM_VERSION "0.3.1"
+#define STREAMING_THRESHOLD_INTERVAL 1000  // reads between re-estimates of the --streaming score threshold
+#define RUN_BYTES_PER_READ 48               // memory per read of a --memory_budget run while it's sorted
 
-KSEQ_INIT(gzFile, gzread)
+KSEQ_INIT(InputStream *, input_stream_read)
+
+
+// Read and base counts shared by all scoring workers, used for the progress display.
+struct ScoringProgress
+{
+    std::mutex mutex;
+    int read_count = 0;
+    long long base_count = 0;
+    long long last_progress = 0;
+
+    void add_read(long long bases, bool verbose) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++read_count;
+        base_count += bases;
+        if (base_count - last_progress >= 483611) {  // a big prime number so progress updates don't round off
+            last_progress = base_count;
+            if (!verbose)
+                print_read_score_progress(read_count, base_count);
+        }
+    }
+};
+
+
+// Reads one FASTQ/FASTA input file, storing its reads as Read objects and calculating their scores. This runs in a
+// worker thread, so problems are saved in the ScoredInput's error for the main thread to report.
+void score_fastx_file(ScoredInput & input, Kmers * kmers, Arguments * args, ScoringProgress & progress) {
+    InputStream stream(input.filename, args->io_uring);
+    kseq_t * seq = kseq_init(&stream);
+    std::ostringstream error;
+
+    int l;
+    while (true) {
+        l = kseq_read(seq);
+        if (l == -1)  // end of file
+            break;
+        if (l == -2) {
+            error << "Error: incorrect FASTQ format for read " << seq->name.s << "\n";
+            break;
+        }
+        if (l == -3) {
+            error << "Error reading " << input.filename << "\n";
+            break;
+        }
+        input.total_bases += seq->seq.l;
+        std::string read_name = seq->name.s;
+
+        bool fasta_format = (seq->qual.l == 0 && seq->seq.l > 0);
+        bool fastq_format = (seq->qual.l > 0 && seq->seq.l > 0 && seq->qual.l == seq->seq.l);
+
+        input.any_fasta = (input.any_fasta || fasta_format);
+        input.any_fastq = (input.any_fastq || fastq_format);
+        if (input.any_fasta && input.any_fastq) {
+            error << "\n\n" << "Error: could not parse input reads" << "\n";
+            error << "  problem occurred at read " << read_name << "\n";
+            break;
+        }
+
+        if (fasta_format && kmers->empty()) {
+            error << "\n\n" << "Error: FASTA input not supported without an external reference" << "\n";
+            break;
+        }
+
+        input.add_read(new Read(read_name, seq->seq.s, seq->qual.s, int(seq->seq.l), kmers, args, 33));
+        progress.add_read(seq->seq.l, args->verbose);
+    }
+    kseq_destroy(seq);
+    input.error = error.str();
+}
+
+
+// Without a reference, scoring only needs read names, lengths and qualities, so FASTQ input is read with a
+// FastqScanner which measures sequence lines without copying them.
+void score_fastq_qualities(ScoredInput & input, Kmers * kmers, Arguments * args, ScoringProgress & progress) {
+    FastqScanner scanner(input.filename, args->io_uring);
+    int l;
+    while ((l = scanner.next()) >= 0) {
+        input.total_bases += l;
+        input.any_fastq = (input.any_fastq || l > 0);
+        Read * read = new Read(scanner.m_name, NULL, scanner.m_qual.data(), l, kmers, args, 33);
+        read->m_record_offset = scanner.m_record_offset;
+        input.add_read(read);
+        progress.add_read(l, args->verbose);
+    }
+    if (l == -2)
+        input.error = "Error: incorrect FASTQ format for read " + scanner.m_name + "\n";
+    else if (l == -3)
+        input.error = "Error reading " + input.filename + "\n";
+    else if (l == -4)
+        input.error = "\n\nError: FASTA input not supported without an external reference\n";
+}
+
+
+// The BAM version of score_fastx_file. Qualities are scored straight from the binary Phred values and the sequence is
+// only decoded when there are reference k-mers to look it up in. Secondary and supplementary alignments are skipped,
+// as they would repeat a read. Each read's virtual offset is saved so the output pass can seek straight to it.
+void score_bam_file(ScoredInput & input, Kmers * kmers, Arguments * args, ScoringProgress & progress,
+                    int decode_threads) {
+    input.bam = true;
+    BamReader reader(input.filename, decode_threads, args->io_uring);
+    if (!reader.read_header()) {
+        input.error = "Error reading " + input.filename + "\n";
+        return;
+    }
+    input.bam_header_text = reader.m_header_text;
+    input.bam_references = reader.m_references;
+
+    BamRecord record;
+    std::vector<char> bases;
+    int result;
+    while ((result = reader.next(record)) == 1) {
+        if (record.is_secondary_or_supplementary())
+            continue;
+        int length = record.length();
+        input.total_bases += length;
+        bool fasta_format = (!record.has_qualities() && length > 0);
+        input.any_fasta = (input.any_fasta || fasta_format);
+        input.any_fastq = (input.any_fastq || record.has_qualities());
+        if (fasta_format && kmers->empty()) {
+            input.error = "\n\nError: BAM input without qualities not supported without an external reference\n";
+            return;
+        }
+
+        char * seq = NULL;
+        if (!kmers->empty()) {
+            record.decode_sequence(bases);
+            seq = bases.data();
+        }
+        char * qscores = reinterpret_cast<char *>(const_cast<unsigned char *>(record.qualities()));
+        Read * read = new Read(record.name(), seq, qscores, length, kmers, args, 0);
+        read->m_record_offset = record.offset;
+        input.add_read(read);
+        progress.add_read(length, args->verbose);
+    }
+    if (result == -1)
+        input.error = "Error reading " + input.filename + "\n";
+}
+
+
+// Writes one FASTQ/FASTA record (or, for a child read, a slice of one). The comment is empty if the record has none.
+void write_fastx_lines(OutputWriter & out, const char * name, const char * comment, const char * seq,
+                       const char * qual, size_t length, bool fasta_output, bool fastq_output) {
+    out.put(fasta_output ? '>' : '@');
+    out.write(name);
+    if (comment[0] != '\0') {
+        out.put(' ');
+        out.write(comment);
+    }
+    out.put('\n');
+    out.write(seq, length);
+    out.put('\n');
+    if (fastq_output) {
+        out.write("+\n", 2);
+        out.write(qual, length);
+        out.put('\n');
+    }
+}
+
+
+// Whether any of a record is in a target's output and if so, how many bases: the whole read, or its passed child reads.
+bool target_output(Read * read, size_t target, long long & bases) {
+    bases = 0;
+    if (read->m_child_reads.size() == 0) {
+        bases = read->m_length;
+        return read->passed_for_target(target);
+    }
+    bool any_passed = false;
+    for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+        int length = read->m_child_read_ranges[i].second - read->m_child_read_ranges[i].first;
+        if (read->m_child_reads[i]->passed_for_target(target) && length > 0) {
+            bases += length;
+            any_passed = true;
+        }
+    }
+    return any_passed;
+}
+
+
+// The name of one of a target's --shards files: the output name with the shard number before its extension (and
+// before any .gz), e.g. out.fastq.gz gives out_1.fastq.gz, out_2.fastq.gz, etc.
+std::string shard_filename(const std::string & filename, int shard, int shards) {
+    if (shards == 1)
+        return filename;
+    std::string base = filename, gz;
+    if (base.size() > 3 && base.compare(base.size() - 3, 3, ".gz") == 0) {
+        gz = ".gz";
+        base.resize(base.size() - 3);
+    }
+    size_t slash = base.find_last_of('/');
+    size_t dot = base.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == 0 || dot == slash + 1)
+        dot = base.size();
+    return base.substr(0, dot) + "_" + std::to_string(shard + 1) + base.substr(dot) + gz;
+}
+
+
+// One target's output: a single writer, or one per --shards file. Each record with something to output goes to one
+// shard, so a read's child reads stay together. By reads, the shards take turns. By bases, each shard takes a run of
+// consecutive records until the bases so far reach its share of the target's total bases, which must be known before
+// the output starts.
+template <typename Writer>
+class ShardedOutput
+{
+public:
+    ShardedOutput(bool by_bases, long long total_bases) :
+        m_by_bases(by_bases), m_total_bases(total_bases), m_shard(0), m_bases(0) {}
+
+    std::vector<Writer *> writers;
+    std::vector<std::string> filenames;    // empty for stdout
+
+    Writer * next(long long bases) {
+        size_t shard = m_shard;
+        if (m_by_bases) {
+            while (m_shard + 1 < writers.size() &&
+                   m_bases >= (long long)(double(m_total_bases) * (m_shard + 1) / writers.size()))
+                ++m_shard;
+            shard = m_shard;
+            m_bases += bases;
+        }
+        else
+            m_shard = (m_shard + 1) % writers.size();
+        return writers[shard];
+    }
+
+private:
+    bool m_by_bases;
+    long long m_total_bases;
+    size_t m_shard;
+    long long m_bases;
+};
+
+
+// Opens a target's FASTQ/FASTA output: stdout, or its --output file (or files, with --shards).
+bool open_fastx_output(ShardedOutput<OutputWriter> & output, Arguments & args, size_t target) {
+    if (args.outputs.empty()) {
+        output.writers.push_back(new OutputWriter(STDOUT_FILENO, false));
+        output.filenames.push_back("");
+        return true;
+    }
+    for (int shard = 0; shard < args.shards; ++shard) {
+        std::string filename = shard_filename(args.outputs[target], shard, args.shards);
+        OutputWriter * file = OutputWriter::open(filename, args.compression_level, args.threads);
+        if (file == NULL) {
+            std::cerr << "Error: could not open output file: " << filename << "\n";
+            return false;
+        }
+        output.writers.push_back(file);
+        output.filenames.push_back(filename);
+    }
+    return true;
+}
+
+
+// Closes and deletes a target's writers. Returns false (after saying so) if any output couldn't be written.
+bool close_fastx_output(ShardedOutput<OutputWriter> & output) {
+    bool ok = true;
+    for (size_t i = 0; i < output.writers.size(); ++i) {
+        if (!output.writers[i]->close() && ok) {
+            std::cerr << "Error: could not write output";
+            if (!output.filenames[i].empty())
+                std::cerr << " file: " << output.filenames[i];
+            std::cerr << "\n";
+            ok = false;
+        }
+        delete output.writers[i];
+    }
+    output.writers.clear();
+    return ok;
+}
+
+
+// Outputs the parts of one FASTQ/FASTA record which passed for the given target: the whole record, or its passed child
+// reads if it was trimmed/split. The comment is empty if the record has none. If raw isn't NULL, it's the record's
+// original bytes, already in the output's format, which are copied for the whole record.
+void write_fastx_record(OutputWriter & out, const char * name, const char * comment, const char * seq,
+                        const char * qual, const char * raw, size_t raw_length, Read * read, size_t target,
+                        bool fasta_output, bool fastq_output) {
+    if (read->m_child_reads.size() == 0) {
+        if (!read->passed_for_target(target))
+            return;
+        if (raw != NULL)
+            out.write(raw, raw_length);
+        else
+            write_fastx_lines(out, name, comment, seq, qual, read->m_length, fasta_output, fastq_output);
+        return;
+    }
+    for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+        Read * child_read = read->m_child_reads[i];
+        int start = read->m_child_read_ranges[i].first;
+        int length = read->m_child_read_ranges[i].second - start;
+        if (child_read->passed_for_target(target) && length > 0)
+            write_fastx_lines(out, child_read->m_name.c_str(), comment, seq + start, fastq_output ? qual + start : qual,
+                              length, fasta_output, fastq_output);
+    }
+}
+
+
+// The parts of a read which aren't in any target's output, as [start, end) ranges of the read. For a read which wasn't
+// trimmed/split, that's the whole read if no target kept it. Otherwise it's everything outside the kept child reads:
+// the trimmed-off ends, the gaps it was split at and any child reads which weren't kept.
+std::vector<std::pair<int,int>> failed_ranges(Read * read, size_t target_count) {
+    std::vector<std::pair<int,int>> ranges;
+    auto kept = [target_count](Read * r) {
+        for (size_t target = 0; target < target_count; ++target) {
+            if (r->passed_for_target(target))
+                return true;
+        }
+        return false;
+    };
+    if (read->m_child_reads.size() == 0) {
+        if (!kept(read))
+            ranges.push_back(std::pair<int,int>(0, read->m_length));
+        return ranges;
+    }
+    int position = 0;
+    for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+        std::pair<int,int> child_read_range = read->m_child_read_ranges[i];
+        if (!kept(read->m_child_reads[i]) || child_read_range.second <= child_read_range.first)
+            continue;
+        if (child_read_range.first > position)
+            ranges.push_back(std::pair<int,int>(position, child_read_range.first));
+        position = child_read_range.second;
+    }
+    if (read->m_length > position)
+        ranges.push_back(std::pair<int,int>(position, read->m_length));
+    return ranges;
+}
+
+
+// A failed range covering the whole read keeps the read's name. A part of a read is named like a child read.
+std::string failed_range_name(Read * read, std::pair<int,int> range) {
+    if (range.first == 0 && range.second == read->m_length)
+        return read->m_name;
+    return read->m_name + "_" + std::to_string(range.first + 1) + "-" + std::to_string(range.second);
+}
+
+
+// Outputs whatever of one FASTQ/FASTA record isn't in any target's output (see failed_ranges). As for
+// write_fastx_record, raw is copied if the whole record failed.
+void write_failed_fastx_record(OutputWriter & out, const char * comment, const char * seq, const char * qual,
+                               const char * raw, size_t raw_length, Read * read, size_t target_count,
+                               bool fasta_output, bool fastq_output) {
+    for (auto range : failed_ranges(read, target_count)) {
+        if (raw != NULL && read->m_child_reads.size() == 0)
+            out.write(raw, raw_length);
+        else
+            write_fastx_lines(out, failed_range_name(read, range).c_str(), comment, seq + range.first,
+                              fastq_output ? qual + range.first : qual, range.second - range.first, fasta_output,
+                              fastq_output);
+    }
+}
+
+
+// For --output_order score: adds each part of a read which some target outputs (the read itself, or its child reads)
+// to the score order. The stage function fills in where the record will be fetched from and its size.
+template <typename Stage>
+void add_ordered_records(ScoreOrder & score_order, Read * read, size_t target_count, uint32_t input, Stage stage) {
+    auto add = [&](Read * leaf, int child) {
+        uint64_t targets = 0;
+        for (size_t target = 0; target < target_count; ++target) {
+            if (leaf->passed_for_target(target))
+                targets |= uint64_t(1) << target;
+        }
+        if (targets == 0)
+            return;
+        OrderedRecord record = {read, child, targets, input, 0, 0};
+        stage(record);
+        score_order.add(record, leaf->m_final_score, leaf->m_length);
+    };
+    if (read->m_child_reads.size() == 0) {
+        add(read, -1);
+        return;
+    }
+    for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+        if (read->m_child_read_ranges[i].second > read->m_child_read_ranges[i].first)
+            add(read->m_child_reads[i], int(i));
+    }
+}
+
+
+// Gives an input's reads in order for the output pass, then NULL after the last one.
+typedef std::function<Read*()> ReadSource;
+
+ReadSource listed_reads(ScoredInput & input) {
+    size_t read_index = 0;
+    return [&input, read_index]() mutable -> Read * {
+        return read_index < input.reads.size() ? input.reads[read_index++] : NULL;
+    };
+}
+
+
+// Reads through a FASTQ/FASTA input file again, outputting each target's keepers to its output and the failures to
+// failed_output (or ignoring them if it's NULL). The file is read in the same order as when it was scored, so each
+// record lines up with the next Read from the input's read source. With a score order, the keepers are staged for
+// write_score_order_fastx instead.
+bool output_fastx_file(ScoredInput & input, ReadSource next_read, std::vector<ShardedOutput<OutputWriter>> & outputs,
+                       OutputWriter * failed_output, ScoreOrder * score_order, bool fasta_output, bool fastq_output,
+                       bool use_io_uring) {
+    FastxReader reader(input.filename, use_io_uring);
+    bool ok = true;
+    int l;
+    while ((l = reader.next()) >= 0) {
+        Read * read = next_read();
+        if (read == NULL || read->m_name != reader.m_name) {
+            std::cerr << "Error: " << input.filename << " changed while Filtlong was running\n";
+            ok = false;
+            break;
+        }
+        const char * name = reader.m_name.c_str();
+        const char * comment = reader.m_comment.c_str();
+        const char * raw = (reader.m_fastq == fastq_output && fasta_output != fastq_output) ? reader.m_raw : NULL;
+        long long bases;
+        if (score_order != NULL) {
+            add_ordered_records(*score_order, read, outputs.size(), 0, [&](OrderedRecord & record) {
+                OutputWriter & stage = score_order->stage();
+                record.offset = stage.position();
+                if (record.child < 0 && raw != NULL)
+                    stage.write(raw, reader.m_raw_length);
+                else if (record.child < 0)
+                    write_fastx_lines(stage, name, comment, reader.m_seq, reader.m_qual, size_t(l), fasta_output,
+                                      fastq_output);
+                else {
+                    int start = read->m_child_read_ranges[record.child].first;
+                    int length = read->m_child_read_ranges[record.child].second - start;
+                    write_fastx_lines(stage, read->m_child_reads[record.child]->m_name.c_str(), comment,
+                                      reader.m_seq + start, fastq_output ? reader.m_qual + start : reader.m_qual,
+                                      length, fasta_output, fastq_output);
+                }
+                record.size = stage.position() - record.offset;
+            });
+        }
+        for (size_t target = 0; target < outputs.size() && score_order == NULL; ++target) {
+            if (target_output(read, target, bases))
+                write_fastx_record(*outputs[target].next(bases), name, comment, reader.m_seq, reader.m_qual, raw,
+                                   reader.m_raw_length, read, target, fasta_output, fastq_output);
+        }
+        if (failed_output != NULL)
+            write_failed_fastx_record(*failed_output, comment, reader.m_seq, reader.m_qual, raw, reader.m_raw_length,
+                                      read, outputs.size(), fasta_output, fastq_output);
+    }
+    if (ok && l < -1) {
+        std::cerr << "Error reading " << input.filename << "\n";
+        ok = false;
+    }
+    return ok;
+}
+
+
+// The BAM version of output_fastx_file. Rather than reading through the whole file, this seeks to each read with
+// something to output, so BGZF blocks holding only failed reads are never decompressed (unless the failed reads are
+// being output too). With a score order, the keepers are only added to it, as write_score_order_bam fetches them from
+// their offsets.
+bool output_bam_file(ScoredInput & input, uint32_t input_index, ReadSource next_read,
+                     std::vector<ShardedOutput<BamWriter>> & outputs, BamWriter * failed_writer, ScoreOrder * score_order,
+                     int decode_threads, bool use_io_uring) {
+    BamReader reader(input.filename, decode_threads, use_io_uring);
+    BamRecord record;
+    Read * read;
+    while ((read = next_read()) != NULL) {
+        if (score_order != NULL) {
+            add_ordered_records(*score_order, read, outputs.size(), input_index, [read](OrderedRecord & record) {
+                record.offset = read->m_record_offset;
+                record.size = 2 * (long long)(read->m_length) + (long long)(read->m_name.size()) + 36;
+            });
+            if (failed_writer == NULL)
+                continue;
+        }
+        bool any_passed = (read->m_child_reads.size() == 0 && read->m_passed);
+        for (auto child : read->m_child_reads)
+            any_passed = (any_passed || child->m_passed);
+        if (!any_passed && failed_writer == NULL)
+            continue;
+        if (!reader.seek(read->m_record_offset) || reader.next(record) != 1 || read->m_name != record.name()) {
+            std::cerr << "Error: " << input.filename << " changed while Filtlong was running\n";
+            return false;
+        }
+        long long bases;
+        for (size_t target = 0; target < outputs.size() && score_order == NULL; ++target) {
+            if (!target_output(read, target, bases))
+                continue;
+            BamWriter * writer = outputs[target].next(bases);
+            if (read->m_child_reads.size() == 0) {
+                writer->write_record(record);
+                continue;
+            }
+            for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+                Read * child_read = read->m_child_reads[i];
+                std::pair<int,int> child_read_range = read->m_child_read_ranges[i];
+                if (child_read->passed_for_target(target) && child_read_range.second > child_read_range.first)
+                    writer->write_child_record(record, child_read->m_name, child_read_range.first,
+                                               child_read_range.second);
+            }
+        }
+        if (failed_writer == NULL)
+            continue;
+        for (auto range : failed_ranges(read, outputs.size())) {
+            if (range.first == 0 && range.second == read->m_length)
+                failed_writer->write_record(record);
+            else
+                failed_writer->write_child_record(record, failed_range_name(read, range), range.first, range.second);
+        }
+    }
+    return true;
+}
+
+
+// Writes the staged FASTQ/FASTA records of a score order to their targets' outputs, best first.
+bool write_score_order_fastx(ScoreOrder & score_order, std::vector<ShardedOutput<OutputWriter>> & outputs) {
+    std::vector<std::string> texts;
+    bool ok = score_order.write_best_first(
+        [&](const OrderedRecord & record, size_t slot) {
+            if (slot >= texts.size())
+                texts.resize(slot + 1);
+            return score_order.fetch_staged(record, texts[slot]);
+        },
+        [&](const OrderedRecord & record, size_t slot, int bases) {
+            for (size_t target = 0; target < outputs.size(); ++target) {
+                if ((record.targets >> target) & 1)
+                    outputs[target].next(bases)->write(texts[slot]);
+            }
+        });
+    if (!ok)
+        std::cerr << "Error: could not read back the staged output\n";
+    return ok;
+}
+
+
+// Fetches the BAM records of a score order from their inputs and writes them to their targets' outputs, best first.
+bool write_score_order_bam(ScoreOrder & score_order, std::vector<ScoredInput> & inputs,
+                           std::vector<ShardedOutput<BamWriter>> & outputs, int decode_threads, bool use_io_uring) {
+    std::vector<std::unique_ptr<BamReader>> readers;
+    for (auto & input : inputs)
+        readers.push_back(std::unique_ptr<BamReader>(new BamReader(input.filename, decode_threads, use_io_uring)));
+    std::vector<BamRecord> records;
+    return score_order.write_best_first(
+        [&](const OrderedRecord & record, size_t slot) {
+            if (slot >= records.size())
+                records.resize(slot + 1);
+            BamReader & reader = *readers[record.input];
+            if (!reader.seek(record.offset) || reader.next(records[slot]) != 1 ||
+                record.read->m_name != records[slot].name()) {
+                std::cerr << "Error: " << inputs[record.input].filename << " changed while Filtlong was running\n";
+                return false;
+            }
+            return true;
+        },
+        [&](const OrderedRecord & record, size_t slot, int bases) {
+            for (size_t target = 0; target < outputs.size(); ++target) {
+                if (((record.targets >> target) & 1) == 0)
+                    continue;
+                BamWriter * writer = outputs[target].next(bases);
+                if (record.child < 0)
+                    writer->write_record(records[slot]);
+                else {
+                    std::pair<int,int> range = record.read->m_child_read_ranges[record.child];
+                    writer->write_child_record(records[slot], record.read->m_child_reads[record.child]->m_name,
+                                               range.first, range.second);
+                }
+            }
+        });
+}
+
+
+// The bases to keep for one target: the smaller of its --target_bases and --keep_percent values, where a single value
+// applies to every target.
+long long target_bases_for(Arguments & args, size_t target, long long total_bases) {
+    long long target_bases = std::numeric_limits<long long>::max();
+    if (args.target_bases_set)
+        target_bases = args.target_bases_list[std::min(target, args.target_bases_list.size() - 1)];
+    if (args.keep_percent_set) {
+        double keep_percent = args.keep_percent_list[std::min(target, args.keep_percent_list.size() - 1)];
+        target_bases = std::min(target_bases, (long long)((keep_percent / 100.0) * total_bases));
+    }
+    return target_bases;
+}
+
+
+// For each of the given targets, keeps the best passed reads up to its bases (see select_best_reads) and clears the
+// target's bit for the other passed reads. Only the cut-offs matter, not the order of the reads on either side of
+// them, so a single target uses a selection rather than a sort. Several targets share one best-first ranking, where
+// each target keeps a prefix. For a large read set, the cut-offs are found from score histograms instead, which avoids
+// making a packed copy of every read, and the targets share the passes over the reads.
+void apply_targets(std::vector<Read*> & reads2, size_t passed_count, const std::vector<size_t> & targets,
+                   const std::vector<long long> & target_bases, std::vector<long long> & kept_bases, int threads) {
+    if (passed_count < HISTOGRAM_SELECTION_MIN_READS) {
+        std::vector<ScoredRead> passed_reads;
+        for (size_t i = 0; i < reads2.size(); ++i) {
+            if (reads2[i]->m_passed)
+                passed_reads.push_back(make_scored_read(reads2[i]->m_final_score, i, reads2[i]->m_length));
+        }
+        if (targets.size() == 1) {
+            size_t target = targets[0];
+            size_t kept_count = select_best_reads(passed_reads, target_bases[target], kept_bases[target]);
+            for (size_t i = kept_count; i < passed_reads.size(); ++i)
+                reads2[passed_reads[i].index]->m_target_mask &= ~(uint64_t(1) << target);
+            return;
+        }
+        sort_best_first(passed_reads, threads);
+        for (auto target : targets)
+            kept_bases[target] = 0;
+        long long bases_so_far = 0;
+        for (auto & passed_read : passed_reads) {
+            for (auto target : targets) {
+                if (bases_so_far < target_bases[target])
+                    kept_bases[target] += passed_read.length;
+                else
+                    reads2[passed_read.index]->m_target_mask &= ~(uint64_t(1) << target);
+            }
+            bases_so_far += passed_read.length;
+        }
+        return;
+    }
+
+    std::vector<HistogramSelector> selectors;
+    for (auto target : targets)
+        selectors.push_back(HistogramSelector(target_bases[target]));
+    while (true) {
+        bool all_done = true;
+        for (auto & selector : selectors)
+            all_done = all_done && selector.done();
+        if (all_done)
+            break;
+        for (size_t i = 0; i < reads2.size(); ++i) {
+            if (!reads2[i]->m_passed)
+                continue;
+            for (auto & selector : selectors) {
+                if (!selector.done())
+                    selector.add(reads2[i]->m_final_score, uint32_t(i), reads2[i]->m_length);
+            }
+        }
+        for (auto & selector : selectors) {
+            if (!selector.done())
+                selector.finish_pass();
+        }
+    }
+    for (size_t i = 0; i < reads2.size(); ++i) {
+        if (!reads2[i]->m_passed)
+            continue;
+        for (size_t j = 0; j < targets.size(); ++j) {
+            if (!selectors[j].keep(reads2[i]->m_final_score, uint32_t(i)))
+                reads2[i]->m_target_mask &= ~(uint64_t(1) << targets[j]);
+        }
+    }
+    for (size_t j = 0; j < targets.size(); ++j)
+        kept_bases[targets[j]] = selectors[j].kept_bases();
+}
+
+
+// With --memory_budget, the scored reads are in each input's spill file rather than in memory. rank reads them back
+// once to count them and to put the passed reads' final scores into sorted runs (see ScoreRuns), and apply_targets then
+// finds every target's cut-off in one best-first walk of the runs. For the output pass, reads gives back an input's
+// reads one at a time, with their final scores and targets applied. The scores, ranking and cut-offs are the same as
+// when all reads are in memory, so the output is too.
+class SpilledReads
+{
+public:
+    SpilledReads(Arguments & args, std::vector<ScoredInput> & inputs, const QualityStats & quality_stats) :
+        m_args(args), m_inputs(inputs), m_normaliser(quality_stats, false),
+        m_scoring(args.target_bases_set || args.keep_percent_set),
+        m_runs(args.temp_dir, size_t(args.memory_budget / RUN_BYTES_PER_READ), args.threads) {}
+
+    // Totals of the reads which will be output (child reads if a read was trimmed/split), set by rank.
+    size_t leaf_count = 0;
+    long long leaf_bases = 0;
+    size_t passed_count = 0;
+    long long passed_bases = 0;
+
+    bool rank() {
+        uint32_t leaf_index = 0;
+        for (auto & input : m_inputs) {
+            m_first_leaf.push_back(leaf_index);
+            if (!input.spill->rewind())
+                return false;
+            Read * read;
+            while ((read = input.spill->read(&m_args)) != NULL) {
+                bool ok = true;
+                for (auto leaf : leaves(read)) {
+                    ++leaf_count;
+                    leaf_bases += leaf->m_length;
+                    if (leaf->m_passed) {
+                        ++passed_count;
+                        passed_bases += leaf->m_length;
+                        if (m_scoring) {
+                            score(leaf);
+                            ok = ok && m_runs.add(leaf->m_final_score, leaf_index, leaf->m_length);
+                        }
+                    }
+                    ++leaf_index;
+                }
+                delete read;
+                if (!ok)
+                    return false;
+            }
+            if (!input.spill->ok())
+                return false;
+        }
+        return m_runs.finish();
+    }
+
+    // Like the main apply_targets, but the targets are only recorded here as cut-offs. They're applied to each read as
+    // it comes back for the output pass.
+    bool apply_targets(const std::vector<size_t> & targets, const std::vector<long long> & target_bases,
+                       std::vector<long long> & kept_bases) {
+        m_targets = targets;
+        m_cut_keys.assign(targets.size(), 0);
+        m_cut_indices.assign(targets.size(), 0);
+        long long most_bases = 0;
+        for (auto target : targets) {
+            kept_bases[target] = 0;
+            most_bases = std::max(most_bases, target_bases[target]);
+        }
+        long long bases_so_far = 0;
+        ScoredRead passed_read;
+        while (bases_so_far < most_bases && m_runs.next(passed_read)) {
+            for (size_t j = 0; j < targets.size(); ++j) {
+                if (bases_so_far < target_bases[targets[j]]) {
+                    kept_bases[targets[j]] += passed_read.length;
+                    m_cut_keys[j] = score_key(passed_read.score);
+                    m_cut_indices[j] = passed_read.index;
+                }
+            }
+            bases_so_far += passed_read.length;
+        }
+        return m_runs.ok();
+    }
+
+    // Each read given out is freed when the next one is asked for.
+    ReadSource reads(size_t input_index) {
+        SpillFile * spill = m_inputs[input_index].spill;
+        uint32_t leaf_index = m_first_leaf[input_index];
+        std::shared_ptr<Read> current;
+        if (!spill->rewind())
+            return [](){return (Read *)(NULL);};
+        return [this, spill, leaf_index, current]() mutable -> Read * {
+            current.reset(spill->read(&m_args));
+            if (current) {
+                for (auto leaf : leaves(current.get()))
+                    apply_cuts(leaf, leaf_index++);
+            }
+            return current.get();
+        };
+    }
+
+private:
+    Arguments & m_args;
+    std::vector<ScoredInput> & m_inputs;
+    QualityNormaliser m_normaliser;
+    bool m_scoring;
+    ScoreRuns m_runs;
+    std::vector<uint32_t> m_first_leaf;    // each input's first leaf index
+
+    std::vector<size_t> m_targets;
+    std::vector<uint64_t> m_cut_keys;
+    std::vector<uint32_t> m_cut_indices;
+
+    static std::vector<Read *> leaves(Read * read) {
+        if (read->m_child_reads.size() == 0)
+            return std::vector<Read *>(1, read);
+        return read->m_child_reads;
+    }
+
+    void score(Read * leaf) {
+        m_normaliser.normalise(leaf);
+        leaf->set_final_score(m_args.length_weight, m_args.mean_q_weight, m_args.window_q_weight);
+    }
+
+    void apply_cuts(Read * leaf, uint32_t leaf_index) {
+        if (!leaf->m_passed || m_targets.empty())
+            return;
+        score(leaf);
+        uint64_t key = score_key(leaf->m_final_score);
+        for (size_t j = 0; j < m_targets.size(); ++j) {
+            if (key < m_cut_keys[j] || (key == m_cut_keys[j] && leaf_index > m_cut_indices[j]))
+                leaf->m_target_mask &= ~(uint64_t(1) << m_targets[j]);
+        }
+    }
+};
+
+
+// A record held back during the --streaming warm-up, until the reads' qualities can be normalised.
+struct HeldRecord
+{
+    std::string name;
+    std::string comment;
+    std::string seq;
+    std::string qual;
+    bool fasta;
+    Read * read;
+};
+
+
+// Scores and outputs reads in one pass for --streaming, so output starts right away and reads aren't kept in memory.
+// The first --warm_up reads are held back and their mean quality statistics are used to normalise every read. The
+// --target_bases/--keep_percent threshold is then estimated from a quantile sketch of the passed reads' scores
+// (weighted by bases) and updated as more reads come in. For --target_bases, the total input size is estimated from
+// how far through the input files the reads so far go, and output stops once the target is reached.
+class ReadStreamer
+{
+public:
+    ReadStreamer(Arguments & args, Kmers * kmers) :
+        m_args(args), m_kmers(kmers), m_out(false, 0), m_normaliser(QualityStats(), true) {
+        m_use_threshold = args.target_bases_set || args.keep_percent_set;
+        m_threshold = -std::numeric_limits<double>::infinity();
+        m_warming_up = true;
+        m_total_file_size = 0;
+        m_finished_file_size = 0;
+        m_current_offset = 0;
+        m_input_bases = 0;
+        m_kept_bases = 0;
+        m_reads_since_threshold = 0;
+        m_any_fasta = false;
+        m_any_fastq = false;
+        for (auto & filename : args.input_reads) {
+            struct stat file_stat;
+            if (stat(filename.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+                m_total_file_size += (long long)(file_stat.st_size);
+        }
+    }
+
+    ~ReadStreamer() {
+        for (auto writer : m_out.writers)
+            delete writer;
+    }
+
+    int run() {
+        std::cerr << "Streaming long reads (scoring and outputting in one pass)\n";
+        if (!open_fastx_output(m_out, m_args, 0))
+            return 1;
+        if (m_args.failed_output_set) {
+            m_failed_out.reset(OutputWriter::open(m_args.failed_output, m_args.compression_level, m_args.threads));
+            if (!m_failed_out) {
+                std::cerr << "Error: could not open output file: " << m_args.failed_output << "\n";
+                return 1;
+            }
+        }
+        for (auto & filename : m_args.input_reads) {
+            if (is_bam_file(filename)) {
+                std::cerr << "\n\n" << "Error: --streaming does not support BAM input" << "\n";
+                return 1;
+            }
+            if (!stream_file(filename))
+                return 1;
+        }
+        if (m_warming_up)
+            finish_warm_up();
+        if (!close_fastx_output(m_out))
+            return 1;
+        if (m_failed_out && !m_failed_out->close()) {
+            std::cerr << "Error: could not write output file: " << m_args.failed_output << "\n";
+            return 1;
+        }
+        print_read_score_progress(m_progress.read_count, m_progress.base_count);
+        std::cerr << "\n\n";
+
+        if (m_args.target_bases_set || m_args.keep_percent_set)
+            std::cerr << "  target: " << int_to_string(target_bases()) << " bp\n";
+        std::cerr << "  kept: " << int_to_string(m_kept_bases) << " bp";
+        if (m_args.target_bases_set || m_args.keep_percent_set)
+            std::cerr << " (" << double_to_string(100.0 * m_kept_bases / std::max(target_bases(), 1LL))
+                      << "% of target)";
+        std::cerr << "\n\n";
+        return 0;
+    }
+
+private:
+    Arguments & m_args;
+    Kmers * m_kmers;
+    ShardedOutput<OutputWriter> m_out;
+    std::unique_ptr<OutputWriter> m_failed_out;
+    ScoringProgress m_progress;
+    QualityStats m_warm_up_stats;
+    QualityNormaliser m_normaliser;
+    QuantileSketch m_sketch;
+    std::vector<HeldRecord> m_held;
+    bool m_use_threshold;
+    double m_threshold;
+    bool m_warming_up;
+    long long m_total_file_size;
+    long long m_finished_file_size;
+    long long m_current_offset;
+    long long m_input_bases;
+    long long m_kept_bases;
+    int m_reads_since_threshold;
+    bool m_any_fasta;
+    bool m_any_fastq;
+
+    bool stream_file(const std::string & filename) {
+        InputStream stream(filename, m_args.io_uring);
+        kseq_t * seq = kseq_init(&stream);
+        bool ok = true;
+        int l;
+        while ((l = kseq_read(seq)) >= 0) {
+            bool fasta_format = (seq->qual.l == 0 && seq->seq.l > 0);
+            bool fastq_format = (seq->qual.l > 0 && seq->seq.l > 0 && seq->qual.l == seq->seq.l);
+            m_any_fasta = (m_any_fasta || fasta_format);
+            m_any_fastq = (m_any_fastq || fastq_format);
+            if (m_any_fasta && m_any_fastq) {
+                std::cerr << "\n\n" << "Error: could not parse input reads" << "\n";
+                std::cerr << "  problem occurred at read " << seq->name.s << "\n";
+                ok = false;
+                break;
+            }
+            if (fasta_format && m_kmers->empty()) {
+                std::cerr << "\n\n" << "Error: FASTA input not supported without an external reference" << "\n";
+                ok = false;
+                break;
+            }
+            m_input_bases += seq->seq.l;
+            m_current_offset = stream.tell();
+            Read * read = new Read(seq->name.s, seq->seq.s, seq->qual.s, int(seq->seq.l), m_kmers, &m_args, 33);
+            m_progress.add_read(seq->seq.l, m_args.verbose);
+
+            if (m_warming_up) {
+                HeldRecord record = {seq->name.s, seq->comment.l > 0 ? seq->comment.s : "", seq->seq.s,
+                                     fastq_format ? seq->qual.s : "", !fastq_format, read};
+                m_held.push_back(record);
+                for_each_output_read(read, [&](Read * r) {m_warm_up_stats.add(r->m_mean_quality);});
+                if (m_held.size() >= size_t(m_args.warm_up))
+                    finish_warm_up();
+                continue;
+            }
+            score(read);
+            if (++m_reads_since_threshold >= STREAMING_THRESHOLD_INTERVAL)
+                update_threshold();
+            output(seq->name.s, seq->comment.l > 0 ? seq->comment.s : "", seq->seq.s, seq->qual.s, !fastq_format,
+                   read);
+        }
+        if (l == -2) {
+            std::cerr << "Error: incorrect FASTQ format for read " << seq->name.s << "\n";
+            ok = false;
+        }
+        else if (l == -3) {
+            std::cerr << "Error reading " << filename << "\n";
+            ok = false;
+        }
+        kseq_destroy(seq);
+        m_finished_file_size += m_current_offset;
+        m_current_offset = 0;
+        return ok;
+    }
+
+    // Calls the function on each read which would be output: the read itself, or its children if trimmed/split.
+    template <typename Function>
+    void for_each_output_read(Read * read, Function function) {
+        if (read->m_child_reads.size() == 0)
+            function(read);
+        for (auto child : read->m_child_reads)
+            function(child);
+    }
+
+    void finish_warm_up() {
+        m_warming_up = false;
+        m_normaliser = QualityNormaliser(m_warm_up_stats, true);
+        for (auto & record : m_held)
+            score(record.read);
+        update_threshold();
+        for (auto & record : m_held)
+            output(record.name.c_str(), record.comment.c_str(), record.seq.c_str(), record.qual.c_str(),
+                   record.fasta, record.read);
+        std::vector<HeldRecord>().swap(m_held);
+    }
+
+    void score(Read * read) {
+        for_each_output_read(read, [&](Read * r) {
+            m_normaliser.normalise(r);
+            r->set_final_score(m_args.length_weight, m_args.mean_q_weight, m_args.window_q_weight);
+            if (isnan(r->m_final_score))   // as with make_scored_read, an unrankable score is the worst
+                r->m_final_score = std::numeric_limits<double>::lowest();
+            if (r->m_passed && m_use_threshold)
+                m_sketch.add(r->m_final_score, r->m_length);
+        });
+    }
+
+    // The bases to keep from the whole input. For --keep_percent this is a fraction of the input bases, so it isn't
+    // final until all reads have been seen.
+    long long target_bases() {
+        long long target = std::numeric_limits<long long>::max();
+        if (m_args.target_bases_set)
+            target = m_args.target_bases;
+        if (m_args.keep_percent_set)
+            target = std::min(target, (long long)((m_args.keep_percent / 100.0) * m_input_bases));
+        return target;
+    }
+
+    // Sets the threshold to the score with the target's share of the bases so far above it. For --target_bases, that
+    // share is the target over the estimated total bases (or everything if the total can't be estimated).
+    void update_threshold() {
+        m_reads_since_threshold = 0;
+        if (!m_use_threshold)
+            return;
+        double share = 1.0;
+        if (m_args.target_bases_set) {
+            long long offset = m_finished_file_size + m_current_offset;
+            if (m_total_file_size > 0 && offset > 0) {
+                double estimated_total_bases = double(m_input_bases) * m_total_file_size / offset;
+                share = std::min(share, m_args.target_bases / estimated_total_bases);
+            }
+        }
+        if (m_args.keep_percent_set)
+            share = std::min(share, m_args.keep_percent / 100.0);
+        double keep_weight = share * m_input_bases;
+        if (keep_weight >= m_sketch.total_weight())
+            m_threshold = -std::numeric_limits<double>::infinity();
+        else
+            m_threshold = m_sketch.value_with_weight_above(keep_weight);
+    }
+
+    void output(const char * name, const char * comment, const char * seq, const char * qual, bool fasta,
+                Read * read) {
+        for_each_output_read(read, [&](Read * r) {
+            if (!r->m_passed)
+                return;
+            if (r->m_final_score < m_threshold || (m_args.target_bases_set && m_kept_bases >= m_args.target_bases))
+                r->m_passed = false;
+            else
+                m_kept_bases += r->m_length;
+        });
+        long long bases;
+        if (target_output(read, 0, bases))
+            write_fastx_record(*m_out.next(bases), name, comment, seq, qual, NULL, 0, read, 0, fasta, !fasta);
+        if (m_failed_out)
+            write_failed_fastx_record(*m_failed_out, comment, seq, qual, NULL, 0, read, 1, fasta, !fasta);
+        delete read;
+    }
+};
 
 
 int main(int argc, char **argv)
@@ -47,87 +1094,166 @@ int main(int argc, char **argv)
     }
 
     std::cerr << "\n";
+    if (args.io_uring && !InputFile::io_uring_available())
+        std::cerr << "Warning: io_uring is not available, reading input files with pread instead\n\n";
+    start_task_pool(args.threads);
+
+    std::vector<ScoredInput> inputs(args.input_reads.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+        inputs[i].filename = args.input_reads[i];
+
+    // If a score cache from an earlier run matches the input files and scoring settings, load the scores from it and
+    // skip the references and scoring entirely.
+    std::string cache_fingerprint;
+    bool scores_loaded = false;
+    if (args.score_cache_set) {
+        cache_fingerprint = score_cache_fingerprint(args);
+        scores_loaded = load_score_cache(args.score_cache, cache_fingerprint, &args, inputs);
+        if (scores_loaded) {
+            int read_count = 0;
+            long long base_count = 0;
+            for (auto & input : inputs) {
+                read_count += int(input.reads.size());
+                base_count += input.total_bases;
+            }
+            std::cerr << "Loading read scores from " << args.score_cache << "\n";
+            print_read_score_progress(read_count, base_count);
+        }
+    }
+
+    // The score table is opened now, so a bad path is caught before any scoring.
+    std::unique_ptr<ScoreTable> score_table;
+    if (args.scores_out_set) {
+        score_table.reset(new ScoreTable(args.scores_out, args.compression_level));
+        if (!score_table->is_open()) {
+            std::cerr << "Error: could not open output file: " << args.scores_out << "\n";
+            return 1;
+        }
+    }
 
     // Read through references and save 16-mers. For assembly references, this will save all 16-mers in the assembly.
     // For short read references, the k-mer needs to appear a few times before it's added to the set.
     Kmers kmers;
-    if (args.assembly_set || args.short_reads.size() > 0) {
+    if (!scores_loaded && (args.assembly_set || args.short_reads.size() > 0)) {
         if (args.assembly_set)
             kmers.add_assembly_fasta(args.assembly);
         if (args.short_reads.size() > 0)
             kmers.add_read_fastqs(args.short_reads);
     }
 
-    // Read through input long reads once, storing them as Read objects and calculating their scores.
-    // While we go, make sure there are no duplicate read names. Quit with an error if so.
+    if (args.streaming) {
+        int exit_code = ReadStreamer(args, &kmers).run();
+        if (exit_code == 0 && args.threads > 1)
+            task_pool().print_utilisation();
+        return exit_code;
+    }
+
+    // With --memory_budget, each input's scored reads go to a spill file rather than staying in memory.
+    if (args.memory_budget_set) {
+        for (auto & input : inputs) {
+            input.spill = new SpillFile(args.temp_dir);
+            if (!input.spill->is_open()) {
+                std::cerr << "Error: could not create a temporary file in " << args.temp_dir << "\n";
+                for (auto & other : inputs)
+                    delete other.spill;
+                return 1;
+            }
+        }
+    }
+
+    // Read through input long reads once, storing them as Read objects and calculating their scores. Each input file
+    // is scored by one task in the task pool, so multiple files are scored concurrently.
+    if (!scores_loaded) {
+        if (!args.verbose)
+            std::cerr << "Scoring long reads\n";
+        ScoringProgress progress;
+        size_t thread_count = std::min(size_t(args.threads), inputs.size());
+        int decode_threads = std::max(1, args.threads / int(thread_count));
+        task_pool().run(SCORING, inputs.size(), [&](size_t i) {
+            if (is_bam_file(inputs[i].filename))
+                score_bam_file(inputs[i], &kmers, &args, progress, decode_threads);
+            else if (kmers.empty())
+                score_fastq_qualities(inputs[i], &kmers, &args, progress);
+            else
+                score_fastx_file(inputs[i], &kmers, &args, progress);
+        });
+        if (!args.verbose)
+            print_read_score_progress(progress.read_count, progress.base_count);
+    }
+
+    // Gather up the per-file results. Check for errors in input order, so the reported problem doesn't depend on
+    // which worker finished first. While we go, make sure there are no duplicate read names. Quit with an error if so.
     long long total_bases = 0;
-    long long last_progress = 0;
+    long long window_skipped_reads = 0;
+    long long window_skipped_bases = 0;
     std::vector<Read*> reads;
+    QualityStats quality_stats;
     std::unordered_map<std::string, Read*> read_dict;
-    if (!args.verbose)
-        std::cerr << "Scoring long reads\n";
-    int l;
-    gzFile fp = gzopen(args.input_reads.c_str(), "r");
-    kseq_t * seq = kseq_init(fp);
-
     bool any_fasta = false;
     bool any_fastq = false;
-
-    while (true) {
-        l = kseq_read(seq);
-        if (l == -1)  // end of file
-            break;
-        if (l == -2) {
-            std::cerr << "Error: incorrect FASTQ format for read " << seq->name.s << "\n";
-            return 1;
+    int exit_code = 0;
+    for (auto & input : inputs) {
+        if (exit_code == 0 && !input.error.empty()) {
+            std::cerr << input.error;
+            exit_code = 1;
         }
-        if (l == -3) {
-            std::cerr << "Error reading " << args.input_reads << "\n";
-            return 1;
+        if (exit_code == 0 && input.bam != inputs[0].bam) {
+            std::cerr << "\n\n" << "Error: BAM and FASTQ/FASTA inputs cannot be mixed" << "\n";
+            exit_code = 1;
         }
-        else {
-            total_bases += seq->seq.l;
-            std::string read_name = seq->name.s;
-
-            bool fasta_format = (seq->qual.l == 0 && seq->seq.l > 0);
-            bool fastq_format = (seq->qual.l > 0 && seq->seq.l > 0 && seq->qual.l == seq->seq.l);
-
-            any_fasta = (any_fasta || fasta_format);
-            any_fastq = (any_fastq || fastq_format);
-            if (any_fasta && any_fastq) {
-                std::cerr << "\n\n" << "Error: could not parse input reads" << "\n";
-                std::cerr << "  problem occurred at read " << read_name << "\n";
-                return 1;
-            }
-
-            if (fasta_format && kmers.empty()) {
-                std::cerr << "\n\n" << "Error: FASTA input not supported without an external reference" << "\n";
-                return 1;
-            }
-
-            Read * read = new Read(read_name, seq->seq.s, seq->qual.s, int(seq->seq.l), &kmers, &args);
+        if (exit_code == 0 && !input.bam && ((any_fasta && input.any_fastq) || (any_fastq && input.any_fasta))) {
+            std::cerr << "\n\n" << "Error: could not parse input reads" << "\n";
+            std::cerr << "  problem occurred in file " << input.filename << "\n";
+            exit_code = 1;
+        }
+        any_fasta = (any_fasta || input.any_fasta);
+        any_fastq = (any_fastq || input.any_fastq);
+        total_bases += input.total_bases;
+        quality_stats.merge(input.quality_stats);
+        window_skipped_reads += input.window_skipped_reads;
+        window_skipped_bases += input.window_skipped_bases;
+        for (auto read : input.reads) {
             reads.push_back(read);
+            if (exit_code != 0)
+                continue;
             if (args.verbose)
                 read->print_verbose_read_info();
-
             if (read_dict.find(read->m_name) != read_dict.end()) {
                 std::cerr << "Error: duplicate read name: " << read->m_name << "\n";
-                return 1;
+                exit_code = 1;
             }
             read_dict[read->m_name] = read;
-
-            if (total_bases - last_progress >= 483611) {  // a big prime number so progress updates don't round off
-                last_progress = total_bases;
-                if (!args.verbose)
-                    print_read_score_progress(reads.size(), total_bases);
-            }
         }
     }
-    kseq_destroy(seq);
-    gzclose(fp);
-    if (!args.verbose)
-        print_read_score_progress(reads.size(), total_bases);
+    // Spilled reads are ranked straight away: the pass which reads them back also gives the totals below.
+    SpilledReads * spilled_reads = NULL;
+    if (exit_code == 0 && args.memory_budget_set) {
+        spilled_reads = new SpilledReads(args, inputs, quality_stats);
+        if (!spilled_reads->rank()) {
+            std::cerr << "Error: could not write temporary files to " << args.temp_dir << "\n";
+            exit_code = 1;
+        }
+    }
+    if (exit_code != 0) {
+        for (auto read : reads)
+            delete read;
+        delete spilled_reads;
+        for (auto & input : inputs)
+            delete input.spill;
+        return exit_code;
+    }
     std::cerr << "\n";
+    if (window_skipped_reads > 0)
+        std::cerr << "  window quality skipped for " << int_to_string(window_skipped_reads) << " reads ("
+                  << int_to_string(window_skipped_bases) << " bp) which failed a length threshold\n";
+
+    // Save freshly calculated scores (before normalisation and filtering change them) so later runs can skip scoring.
+    if (args.score_cache_set && !scores_loaded) {
+        if (save_score_cache(args.score_cache, cache_fingerprint, inputs))
+            std::cerr << "Saved read scores to " << args.score_cache << "\n\n";
+        else
+            std::cerr << "Warning: could not write score cache: " << args.score_cache << "\n\n";
+    }
 
     // Determine the output format.
     bool fasta_output = any_fasta;
@@ -153,169 +1279,235 @@ int main(int argc, char **argv)
 
     // If --trim or --split was used, display some summary info here.
     if (args.trim || args.split_set) {
+        size_t count_after_trim_split = reads2.size();
         long long total_after_trim_split = 0;
         for (auto read : reads2)
             total_after_trim_split += read->m_length;
+        if (spilled_reads != NULL) {
+            count_after_trim_split = spilled_reads->leaf_count;
+            total_after_trim_split = spilled_reads->leaf_bases;
+        }
         if (args.trim && args.split_set)
             std::cerr << "  after trimming and splitting: ";
         else if (args.trim)
             std::cerr << "  after trimming: ";
         else
             std::cerr << "  after splitting: ";
-        std::cerr << int_to_string(reads2.size()) << " reads (" << int_to_string(total_after_trim_split) << " bp)\n";
+        std::cerr << int_to_string(count_after_trim_split) << " reads (" << int_to_string(total_after_trim_split)
+                  << " bp)\n";
     }
     std::cerr << "\n";
 
-    // Go through the mean quality scores and find the min, max, mean and standard deviation.
-    double min_quality = 100.0;
-    double max_quality = 0.0;
-    double quality_sum = 0.0;
-    for (auto read : reads2) {
-        quality_sum += read->m_mean_quality;
-        if (read->m_mean_quality > max_quality)
-            max_quality = read->m_mean_quality;
-        if (read->m_mean_quality < min_quality)
-            min_quality = read->m_mean_quality;
-    }
-    double mean_quality = quality_sum / reads2.size();
-    double stdev_sum = 0.0;
-    for (auto read : reads2) {
-        double mean_diff = read->m_mean_quality - mean_quality;
-        stdev_sum += mean_diff * mean_diff;
-    }
-    double stdev_quality = sqrt(stdev_sum / reads2.size());
-    double min_z_score, max_z_score;
-    if (stdev_quality > 0.0) {
-        min_z_score = (min_quality - mean_quality) / stdev_quality;
-        max_z_score = (max_quality - mean_quality) / stdev_quality;
-    }
-    else {
-        min_z_score = 1.0;
-        max_z_score = 1.0;
+    // Now normalise each read's quality scores and give it a final score, using the mean quality statistics gathered
+    // while the reads were scored. Only --target_bases, --keep_percent, --verbose, --scores_out and --output_order
+    // score use these, so without them this step is skipped. Spilled reads were given their final scores while they were ranked.
+    // Normalising replaces the raw qualities, so they're saved first for the score table.
+    std::vector<std::pair<double,double>> raw_qualities;
+    if ((args.target_bases_set || args.keep_percent_set || args.verbose || args.scores_out_set ||
+         args.output_order_score) && spilled_reads == NULL) {
+        QualityNormaliser normaliser(quality_stats, false);
+        if (args.verbose)
+            std::cerr << "\n\n" << "Read name" << "\t" << "Length score" << "\t" << "Mean quality score" << "\t"
+                      << "Window quality score" << "\t" << "Final score" << "\n";
+        if (score_table)
+            raw_qualities.reserve(reads2.size());
+        for (auto read : reads2) {
+            if (score_table)
+                raw_qualities.push_back(std::pair<double,double>(read->m_mean_quality, read->m_window_quality));
+            normaliser.normalise(read);
+            read->set_final_score(args.length_weight, args.mean_q_weight, args.window_q_weight);
+            if (args.verbose)
+                read->print_scores(longest_read_name);
+        }
+        if (args.verbose)
+            std::cerr << "\n";
     }
-    double max_min_z_diff = max_z_score - min_z_score;
 
-    // Now normalise each read's quality scores.
-    if (args.verbose)
-        std::cerr << "\n\n" << "Read name" << "\t" << "Length score" << "\t" << "Mean quality score" << "\t"
-                  << "Window quality score" << "\t" << "Final score" << "\n";
+    // See how many bases have already been passed. Without --target_bases or --keep_percent, these are what's kept.
+    long long passed_bases = 0;
+    size_t passed_count = 0;
     for (auto read : reads2) {
-        double window_ratio = read->m_window_quality / read->m_mean_quality;
-        if (window_ratio > 1.0)
-            window_ratio = 1.0;
-        double quality_z_score = (read->m_mean_quality - mean_quality) / stdev_quality;
-        read->m_mean_quality = 100.0 * (quality_z_score - min_z_score) / max_min_z_diff;
-        read->m_window_quality = read->m_mean_quality * window_ratio;
-        read->set_final_score(args.length_weight, args.mean_q_weight, args.window_q_weight);
-        if (args.verbose)
-            read->print_scores(longest_read_name);
+        if (read->m_passed) {
+            passed_bases += read->m_length;
+            ++passed_count;
+        }
     }
-    if (args.verbose)
-        std::cerr << "\n";
+    if (spilled_reads != NULL) {
+        passed_bases = spilled_reads->passed_bases;
+        passed_count = spilled_reads->passed_count;
+    }
+    std::vector<long long> kept_bases(args.target_count, passed_bases);
 
     // If the user set thresholds using either --target_bases or --keep_percent, then we need to see which additional
-    // reads should be labelled as failed.
+    // reads should be labelled as failed. With multiple targets, each one has its own set of kept reads.
     if (args.target_bases_set || args.keep_percent_set) {
         std::cerr << "Filtering long reads\n";
 
-        // See how many bases have already been passed.
-        long long passed_bases = 0;
-        for (auto read : reads2) {
-            if (read->m_passed)
-                passed_bases += read->m_length;
-        }
-
-        // Determine how many bases we should keep.
-        long long target_bases;
-        if (args.target_bases_set)
-            target_bases = args.target_bases;
-        else
-            target_bases = std::numeric_limits<long long>::max();
-        if (args.keep_percent_set) {
-            long long keep_target = (long long)((args.keep_percent / 100.0) * total_bases);
-            target_bases = std::min(target_bases, keep_target);
+        // Determine how many bases we should keep for each target, and which targets need reads failed.
+        std::vector<long long> target_bases(args.target_count);
+        std::vector<size_t> selecting_targets;
+        for (size_t target = 0; target < args.target_count; ++target) {
+            target_bases[target] = target_bases_for(args, target, total_bases);
+            if (target_bases[target] < total_bases && target_bases[target] < passed_bases)
+                selecting_targets.push_back(target);
         }
-        std::cerr << "  target: " << int_to_string(target_bases) << " bp\n";
-        if (target_bases >= total_bases) {
-            std::cerr << "  not enough reads to reach target\n";
-        }
-        else if (target_bases >= passed_bases) {
-            std::cerr << "  reads already fall below target after filtering\n";
-        }
-        else {
-            // Sort reads from best to worst.
-            std::sort(reads2.begin(), reads2.end(),
-                      [](const Read* a, const Read* b) {return a->m_final_score > b->m_final_score;});
-
-            // Fail all reads after the threshold has been met.
-            long long bases_so_far = 0;
-            for (auto read : reads2) {
-                if (read->m_passed && bases_so_far < target_bases)
-                    bases_so_far += read->m_length;
-                else
-                    read->m_passed = false;
+        if (spilled_reads != NULL) {
+            bool cuts_found = selecting_targets.empty() ||
+                              spilled_reads->apply_targets(selecting_targets, target_bases, kept_bases);
+            if (!cuts_found) {
+                std::cerr << "Error: could not read temporary files in " << args.temp_dir << "\n";
+                delete spilled_reads;
+                for (auto & input : inputs)
+                    delete input.spill;
+                return 1;
             }
-            std::cerr << "  keeping " << int_to_string(bases_so_far) << " bp\n";
+        }
+        else if (!selecting_targets.empty())
+            apply_targets(reads2, passed_count, selecting_targets, target_bases, kept_bases, args.threads);
+
+        for (size_t target = 0; target < args.target_count; ++target) {
+            std::cerr << "  target: " << int_to_string(target_bases[target]) << " bp";
+            if (args.target_count > 1)
+                std::cerr << " (" << args.outputs[target] << ")";
+            std::cerr << "\n";
+            if (target_bases[target] >= total_bases)
+                std::cerr << "  not enough reads to reach target\n";
+            else if (target_bases[target] >= passed_bases)
+                std::cerr << "  reads already fall below target after filtering\n";
+            else
+                std::cerr << "  keeping " << int_to_string(kept_bases[target]) << " bp\n";
         }
         std::cerr << "\n";
     }
 
-    // Read through input reads again, this time outputting the keepers to stdout and ignoring the failures.
+    // Read through input reads again, this time outputting the keepers and ignoring the failures. Every target's
+    // output is written in this one pass. BAM input gives BAM output, using the header from the BAM input(s). With
+    // --output_order score, this pass only gathers the keepers, which are then written best first.
     std::cerr << "Outputting passed long reads\n";
-    fp = gzopen(args.input_reads.c_str(), "r");
-    seq = kseq_init(fp);
-    while ((l = kseq_read(seq)) >= 0) {
-        Read * read = read_dict[seq->name.s];
-
-        if (read->m_child_reads.size() == 0) {
-            if (read->m_passed) {
-                std::cout << (fasta_output ? ">" : "@");
-                std::cout << seq->name.s;
-                if (seq->comment.l > 0)
-                    std::cout << " " << seq->comment.s;
-                std::cout << "\n";
-                std::cout << seq->seq.s << "\n";
-                if (fastq_output) {
-                    std::cout << "+\n";
-                    std::cout << seq->qual.s << "\n";
+    if (score_table)
+        score_table->start(reads, raw_qualities, args.target_count);
+    bool output_ok = true;
+    std::unique_ptr<ScoreOrder> score_order;
+    if (args.output_order_score)
+        score_order.reset(new ScoreOrder(args.temp_dir, args.threads));
+    if (inputs[0].bam) {
+        std::vector<std::string> header_texts;
+        for (auto & input : inputs)
+            header_texts.push_back(input.bam_header_text);
+        std::string header_text = merge_bam_header_text(header_texts);
+        std::vector<FILE *> files;
+        std::vector<ShardedOutput<BamWriter>> outputs;
+        for (size_t target = 0; target < args.target_count && output_ok; ++target) {
+            outputs.push_back(ShardedOutput<BamWriter>(args.shard_by_bases, kept_bases[target]));
+            for (int shard = 0; shard < args.shards; ++shard) {
+                std::string filename;
+                if (!args.outputs.empty())
+                    filename = shard_filename(args.outputs[target], shard, args.shards);
+                FILE * file = filename.empty() ? stdout : fopen(filename.c_str(), "wb");
+                if (file == NULL) {
+                    std::cerr << "Error: could not open output file: " << filename << "\n";
+                    output_ok = false;
+                    break;
                 }
+                files.push_back(file);
+                outputs.back().writers.push_back(new BamWriter(file, args.compression_level, args.threads));
+                outputs.back().filenames.push_back(filename);
+                outputs.back().writers.back()->write_header(header_text, inputs[0].bam_references);
             }
         }
-        else {
-            for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
-                Read * child_read = read->m_child_reads[i];
-                if (child_read->m_passed) {
-                    std::pair<int,int> child_read_range = read->m_child_read_ranges[i];
-                    int start = child_read_range.first;
-                    int end = child_read_range.second;
-                    int length = end - start;
-                    if (length > 0) {
-                        std::cout << (fasta_output ? ">" : "@");
-                        std::cout << child_read->m_name;
-                        if (seq->comment.l > 0)
-                            std::cout << " " << seq->comment.s;
-                        std::cout << "\n";
-
-                        std::string seq_str = seq->seq.s;
-                        std::cout << seq_str.substr(start, length) << "\n";
-
-                        if (fastq_output) {
-                            std::string qual_str = seq->qual.s;
-                            std::cout << "+\n";
-                            std::cout << qual_str.substr(start, length) << "\n";
-                        }
-                    }
+        FILE * failed_file = NULL;
+        BamWriter * failed_writer = NULL;
+        if (args.failed_output_set && output_ok) {
+            failed_file = fopen(args.failed_output.c_str(), "wb");
+            if (failed_file == NULL) {
+                std::cerr << "Error: could not open output file: " << args.failed_output << "\n";
+                output_ok = false;
+            }
+            else {
+                failed_writer = new BamWriter(failed_file, args.compression_level, args.threads);
+                failed_writer->write_header(header_text, inputs[0].bam_references);
+            }
+        }
+        for (size_t i = 0; i < inputs.size() && output_ok; ++i) {
+            ReadSource source = spilled_reads != NULL ? spilled_reads->reads(i) : listed_reads(inputs[i]);
+            output_ok = output_bam_file(inputs[i], uint32_t(i), source, outputs, failed_writer, score_order.get(),
+                                        args.threads, args.io_uring);
+        }
+        if (score_order && output_ok)
+            output_ok = write_score_order_bam(*score_order, inputs, outputs, args.threads, args.io_uring);
+        size_t file_index = 0;
+        for (auto & output : outputs) {
+            for (size_t i = 0; i < output.writers.size(); ++i, ++file_index) {
+                output.writers[i]->close();
+                delete output.writers[i];
+                FILE * file = files[file_index];
+                if (file != stdout && fclose(file) != 0 && output_ok) {
+                    std::cerr << "Error: could not write output file: " << output.filenames[i] << "\n";
+                    output_ok = false;
                 }
             }
         }
+        if (failed_writer != NULL) {
+            failed_writer->close();
+            delete failed_writer;
+            if (fclose(failed_file) != 0 && output_ok) {
+                std::cerr << "Error: could not write output file: " << args.failed_output << "\n";
+                output_ok = false;
+            }
+        }
+    }
+    else {
+        std::vector<ShardedOutput<OutputWriter>> outputs;
+        for (size_t target = 0; target < args.target_count && output_ok; ++target) {
+            outputs.push_back(ShardedOutput<OutputWriter>(args.shard_by_bases, kept_bases[target]));
+            output_ok = open_fastx_output(outputs.back(), args, target);
+        }
+        if (score_order && output_ok && !score_order->open_stage()) {
+            std::cerr << "Error: could not create a temporary file in " << args.temp_dir << "\n";
+            output_ok = false;
+        }
+        OutputWriter * failed_output = NULL;
+        if (args.failed_output_set && output_ok) {
+            failed_output = OutputWriter::open(args.failed_output, args.compression_level, args.threads);
+            if (failed_output == NULL) {
+                std::cerr << "Error: could not open output file: " << args.failed_output << "\n";
+                output_ok = false;
+            }
+        }
+        for (size_t i = 0; i < inputs.size() && output_ok; ++i) {
+            ReadSource source = spilled_reads != NULL ? spilled_reads->reads(i) : listed_reads(inputs[i]);
+            output_ok = output_fastx_file(inputs[i], source, outputs, failed_output, score_order.get(),
+                                          fasta_output, fastq_output, args.io_uring);
+        }
+        if (score_order && output_ok)
+            output_ok = write_score_order_fastx(*score_order, outputs);
+        if (failed_output != NULL) {
+            if (!failed_output->close() && output_ok) {
+                std::cerr << "Error: could not write output file: " << args.failed_output << "\n";
+                output_ok = false;
+            }
+            delete failed_output;
+        }
+        for (auto & output : outputs)
+            output_ok = close_fastx_output(output) && output_ok;
+    }
+
+    if (score_table && !score_table->finish() && output_ok) {
+        std::cerr << "Error: could not write output file: " << args.scores_out << "\n";
+        output_ok = false;
     }
-    kseq_destroy(seq);
-    gzclose(fp);
 
     // Clean up.
     for (auto read : reads)
         delete read;
+    delete spilled_reads;
+    for (auto & input : inputs)
+        delete input.spill;
+    if (!output_ok)
+        return 1;
 
     std::cerr << "\n";
+    if (args.threads > 1)
+        task_pool().print_utilisation();
     return 0;
 }
@@ -16,6 +16,8 @@
 
 #include "misc.h"
 
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -39,6 +41,56 @@ std::string int_to_string(long long n) {
     return ss.str();
 }
 
+
+void append_integer(std::string & s, long long n) {
+    char digits[24];
+    int i = 24;
+    unsigned long long u = n < 0 ? 0ULL - (unsigned long long)(n) : (unsigned long long)(n);
+    do {
+        digits[--i] = char('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (n < 0)
+        digits[--i] = '-';
+    s.append(digits + i, 24 - i);
+}
+
+
+// Rounds to the given number of decimal places (at most 6), like printf's %f. Values too big to scale into an integer
+// fall back to snprintf.
+void append_fixed(std::string & s, double n, int decimals) {
+    static const long long powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (std::isnan(n)) {
+        s += "nan";
+        return;
+    }
+    if (std::isinf(n)) {
+        s += n < 0 ? "-inf" : "inf";
+        return;
+    }
+    double scaled = std::round(std::fabs(n) * powers[decimals]);
+    if (scaled >= 1e18) {
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, n);
+        s += buffer;
+        return;
+    }
+    long long whole = (long long)(scaled);
+    if (n < 0 && whole != 0)
+        s += '-';
+    append_integer(s, whole / powers[decimals]);
+    if (decimals > 0) {
+        char digits[6];
+        long long fraction = whole % powers[decimals];
+        for (int i = decimals - 1; i >= 0; --i) {
+            digits[i] = char('0' + fraction % 10);
+            fraction /= 10;
+        }
+        s += '.';
+        s.append(digits, decimals);
+    }
+}
+
 void print_hash_progress(std::string filename, long long base_count) {
     std::cerr << "\r  " << filename << " (" << int_to_string(base_count) << " bp)";
 }
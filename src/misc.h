@@ -20,6 +20,11 @@
 
 std::string double_to_string(double n);
 std::string int_to_string(long long n);
+
+// Fast, locale-independent formatting for machine-readable output: these append to the string rather than going
+// through a stringstream.
+void append_integer(std::string & s, long long n);
+void append_fixed(std::string & s, double n, int decimals);
 void print_hash_progress(std::string filename, long long base_count);
 void print_read_score_progress(int read_count, long long base_count);
 
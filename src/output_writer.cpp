@@ -0,0 +1,118 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include "output_writer.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+OutputWriter::OutputWriter(int fd, bool close_fd) :
+    m_fd(fd), m_close_fd(close_fd), m_file(NULL), m_ok(true), m_buffer(OUTPUT_WRITER_BUFFER_BYTES), m_used(0),
+    m_flushed(0) {
+}
+
+
+// Compresses to the file, which is closed along with the writer.
+OutputWriter::OutputWriter(FILE * file, int compression_level, int threads) :
+    m_fd(fileno(file)), m_close_fd(false), m_file(file), m_bgzf(new BgzfWriter(file, compression_level, threads)),
+    m_ok(true), m_buffer(OUTPUT_WRITER_BUFFER_BYTES), m_used(0), m_flushed(0) {
+}
+
+
+OutputWriter::~OutputWriter() {
+    close();
+}
+
+
+// Returns NULL if the file can't be opened for writing.
+OutputWriter * OutputWriter::open(const std::string & filename, int compression_level, int threads) {
+    std::string gz = ".gz";
+    if (filename.size() > gz.size() && filename.compare(filename.size() - gz.size(), gz.size(), gz) == 0) {
+        FILE * file = fopen(filename.c_str(), "wb");
+        if (file == NULL)
+            return NULL;
+        return new OutputWriter(file, compression_level, threads);
+    }
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return NULL;
+    return new OutputWriter(fd, true);
+}
+
+
+// Writes the buffer followed by the data, carrying on after partial writes until it's all gone. When compressing,
+// both go to the BGZF writer instead.
+void OutputWriter::write_through(const char * data, size_t length) {
+    m_flushed += (long long)(m_used + length);
+    if (m_bgzf) {
+        m_bgzf->write(m_buffer.data(), m_used);
+        m_bgzf->write(data, length);
+        m_used = 0;
+        return;
+    }
+    struct iovec parts[2];
+    parts[0].iov_base = m_buffer.data();
+    parts[0].iov_len = m_used;
+    parts[1].iov_base = const_cast<char *>(data);
+    parts[1].iov_len = length;
+    struct iovec * next = parts;
+    int count = 2;
+    while (m_ok && count > 0) {
+        ssize_t written = writev(m_fd, next, count);
+        if (written < 0) {
+            if (errno != EINTR)
+                m_ok = false;
+            continue;
+        }
+        while (count > 0 && size_t(written) >= next->iov_len) {
+            written -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<char *>(next->iov_base) + written;
+            next->iov_len -= written;
+        }
+    }
+    m_used = 0;
+}
+
+
+bool OutputWriter::flush() {
+    if (m_used > 0)
+        write_through(NULL, 0);
+    return m_ok;
+}
+
+
+// Flushes and (for a file) closes the descriptor. Returns false if any write failed.
+bool OutputWriter::close() {
+    flush();
+    if (m_bgzf) {
+        m_bgzf->close();
+        m_bgzf.reset();
+        m_ok = !ferror(m_file) && m_ok;
+        m_ok = (fclose(m_file) == 0) && m_ok;
+        m_file = NULL;
+    }
+    if (m_close_fd) {
+        m_ok = (::close(m_fd) == 0) && m_ok;
+        m_close_fd = false;
+    }
+    return m_ok;
+}
@@ -0,0 +1,82 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bgzf.h"
+
+
+#define OUTPUT_WRITER_BUFFER_BYTES (1 << 20)
+#define OUTPUT_WRITER_DIRECT_BYTES (1 << 16)
+
+
+// Writes FASTQ/FASTA output to a file descriptor (a file or stdout) through one large buffer, with no iostream in the
+// way. A slice bigger than OUTPUT_WRITER_DIRECT_BYTES (e.g. a long read's sequence) isn't copied into the buffer: it's
+// written along with whatever is already buffered using a single writev. Write errors are remembered and reported by
+// close. A file whose name ends in .gz is instead compressed as BGZF (readable by gzip), using multiple threads.
+class OutputWriter
+{
+public:
+    OutputWriter(int fd, bool close_fd);
+    OutputWriter(FILE * file, int compression_level, int threads);
+    ~OutputWriter();
+
+    static OutputWriter * open(const std::string & filename, int compression_level, int threads);
+
+    void write(const char * data, size_t length) {
+        if (length >= size_t(OUTPUT_WRITER_DIRECT_BYTES) || length > m_buffer.size() - m_used) {
+            write_through(data, length);
+            return;
+        }
+        memcpy(m_buffer.data() + m_used, data, length);
+        m_used += length;
+    }
+    void write(const char * text) {write(text, strlen(text));}
+    void write(const std::string & text) {write(text.data(), text.size());}
+    void put(char c) {
+        if (m_used == m_buffer.size())
+            flush();
+        m_buffer[m_used++] = c;
+    }
+
+    long long position() {return m_flushed + (long long)(m_used);}    // bytes written so far (before compression)
+
+    bool flush();
+    bool close();
+
+private:
+    int m_fd;
+    bool m_close_fd;
+    FILE * m_file;
+    std::unique_ptr<BgzfWriter> m_bgzf;
+    bool m_ok;
+    std::vector<char> m_buffer;
+    size_t m_used;
+    long long m_flushed;
+
+    void write_through(const char * data, size_t length);
+};
+
+
+#endif // OUTPUT_WRITER_H
@@ -0,0 +1,91 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "quality_stats.h"
+#include "read.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+void QualityStats::add(double quality) {
+    ++count;
+    double delta = quality - mean;
+    mean += delta / count;
+    m2 += delta * (quality - mean);
+    if (quality < min)
+        min = quality;
+    if (quality > max)
+        max = quality;
+}
+
+
+// Chan et al.'s pairwise update, which gives the same result (up to rounding) as adding the other's reads one by one.
+void QualityStats::merge(const QualityStats & other) {
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    long long total = count + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / total;
+    m2 += other.m2 + delta * delta * count * other.count / total;
+    count = total;
+    if (other.min < min)
+        min = other.min;
+    if (other.max > max)
+        max = other.max;
+}
+
+
+// The population standard deviation.
+double QualityStats::stdev() const {
+    return sqrt(m2 / count);
+}
+
+
+QualityNormaliser::QualityNormaliser(const QualityStats & stats, bool clamp) {
+    double min_quality = std::min(stats.min, 100.0);
+    double max_quality = std::max(stats.max, 0.0);
+    m_mean = stats.mean;
+    m_stdev = stats.stdev();
+    double min_z_score, max_z_score;
+    if (m_stdev > 0.0) {
+        min_z_score = (min_quality - m_mean) / m_stdev;
+        max_z_score = (max_quality - m_mean) / m_stdev;
+    }
+    else {
+        min_z_score = 1.0;
+        max_z_score = 1.0;
+    }
+    m_min_z_score = min_z_score;
+    m_max_min_z_diff = max_z_score - min_z_score;
+    m_clamp = clamp;
+}
+
+
+void QualityNormaliser::normalise(Read * read) {
+    double window_ratio = read->m_window_quality / read->m_mean_quality;
+    if (window_ratio > 1.0)
+        window_ratio = 1.0;
+    double quality_z_score = (read->m_mean_quality - m_mean) / m_stdev;
+    read->m_mean_quality = 100.0 * (quality_z_score - m_min_z_score) / m_max_min_z_diff;
+    if (m_clamp)
+        read->m_mean_quality = std::max(0.0, std::min(read->m_mean_quality, 100.0));
+    read->m_window_quality = read->m_mean_quality * window_ratio;
+}
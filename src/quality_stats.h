@@ -0,0 +1,62 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef QUALITY_STATS_H
+#define QUALITY_STATS_H
+
+
+#include <limits>
+
+
+class Read;
+
+
+// The count, mean, variance, min and max of read mean qualities. Reads are added one at a time as they are scored,
+// using Welford's algorithm, so there's no need for extra passes over the reads afterward. Statistics gathered in
+// different threads can be merged.
+struct QualityStats
+{
+    long long count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;    // sum of squared differences from the mean
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void add(double quality);
+    void merge(const QualityStats & other);
+    double stdev() const;
+};
+
+
+// Turns reads' raw mean and window qualities into normalised ones, using mean quality statistics: z-scores are scaled
+// so the mean qualities in the statistics span 0 to 100, and each window quality keeps its ratio to the mean quality
+// (capped at 1). With clamp, reads from outside the statistics which fall beyond that span are put at 0 or 100.
+class QualityNormaliser
+{
+public:
+    QualityNormaliser(const QualityStats & stats, bool clamp);
+
+    void normalise(Read * read);
+
+private:
+    double m_mean;
+    double m_stdev;
+    double m_min_z_score;
+    double m_max_min_z_diff;
+    bool m_clamp;
+};
+
+
+#endif // QUALITY_STATS_H
@@ -0,0 +1,131 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "quantile_sketch.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+
+QuantileSketch::QuantileSketch(double compression) :
+        m_compression(compression),
+        m_min(std::numeric_limits<double>::infinity()),
+        m_max(-std::numeric_limits<double>::infinity()) {
+}
+
+
+void QuantileSketch::add(double value, double weight) {
+    if (weight <= 0.0 || isnan(value))
+        return;
+    m_buffer.push_back(Centroid{value, weight});
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+    if (m_buffer.size() >= size_t(5 * m_compression))
+        compress();
+}
+
+
+void QuantileSketch::merge(const QuantileSketch & other) {
+    m_buffer.insert(m_buffer.end(), other.m_centroids.begin(), other.m_centroids.end());
+    m_buffer.insert(m_buffer.end(), other.m_buffer.begin(), other.m_buffer.end());
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    compress();
+}
+
+
+double QuantileSketch::total_weight() {
+    compress();
+    double total = 0.0;
+    for (auto & centroid : m_centroids)
+        total += centroid.weight;
+    return total;
+}
+
+
+// Merges the buffer into the centroids. Neighbouring centroids (in value order) are combined as long as the result
+// spans no more than one unit of the k1 scale function, k(q) = compression / 2pi * asin(2q - 1), which limits the
+// centroids to about compression / 2 and makes them smallest at the tails.
+void QuantileSketch::compress() {
+    if (m_buffer.empty())
+        return;
+    m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+    std::sort(m_buffer.begin(), m_buffer.end(), [](const Centroid & a, const Centroid & b) {return a.mean < b.mean;});
+    double total = 0.0;
+    for (auto & centroid : m_buffer)
+        total += centroid.weight;
+
+    auto weight_limit = [&](double weight_so_far) {
+        double k = m_compression / (2.0 * M_PI) * asin(2.0 * weight_so_far / total - 1.0) + 1.0;
+        if (k >= m_compression / 4.0)
+            return total;
+        return total * (sin(2.0 * M_PI * k / m_compression) + 1.0) / 2.0;
+    };
+
+    m_centroids.clear();
+    Centroid current = m_buffer[0];
+    double weight_so_far = 0.0;
+    double limit = weight_limit(0.0);
+    for (size_t i = 1; i < m_buffer.size(); ++i) {
+        const Centroid & next = m_buffer[i];
+        if (weight_so_far + current.weight + next.weight <= limit) {
+            current.weight += next.weight;
+            current.mean += (next.mean - current.mean) * next.weight / current.weight;
+        }
+        else {
+            weight_so_far += current.weight;
+            m_centroids.push_back(current);
+            current = next;
+            limit = weight_limit(weight_so_far);
+        }
+    }
+    m_centroids.push_back(current);
+    m_buffer.clear();
+}
+
+
+// Returns the value which has about the given weight at or above it. Each centroid's weight is taken to be spread
+// around its mean, so the answer is interpolated between the means of the centroids on either side (or the min/max
+// at the ends).
+double QuantileSketch::value_with_weight_above(double weight) {
+    compress();
+    if (m_centroids.empty())
+        return std::numeric_limits<double>::quiet_NaN();
+    double total = 0.0;
+    for (auto & centroid : m_centroids)
+        total += centroid.weight;
+    double position = total - weight;   // the same point measured from the bottom
+    if (position <= 0.0)
+        return m_min;
+    if (position >= total)
+        return m_max;
+
+    double weight_so_far = 0.0;
+    for (size_t i = 0; i < m_centroids.size(); ++i) {
+        double centre = weight_so_far + m_centroids[i].weight / 2.0;
+        if (position < centre) {
+            double previous_value = (i == 0) ? m_min : m_centroids[i - 1].mean;
+            double previous_centre = (i == 0) ? 0.0 : weight_so_far - m_centroids[i - 1].weight / 2.0;
+            double fraction = (position - previous_centre) / (centre - previous_centre);
+            return previous_value + fraction * (m_centroids[i].mean - previous_value);
+        }
+        weight_so_far += m_centroids[i].weight;
+    }
+    double last_centre = total - m_centroids.back().weight / 2.0;
+    double fraction = (position - last_centre) / (total - last_centre);
+    return m_centroids.back().mean + fraction * (m_max - m_centroids.back().mean);
+}
@@ -0,0 +1,54 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+
+#include <vector>
+
+
+// A merging t-digest (Dunning and Ertl): a summary of a weighted distribution, held in a bounded number of centroids,
+// which answers quantile queries approximately. Centroids are kept smaller near the tails, where the error is lowest.
+// Sketches can be merged, e.g. to combine ones built in different threads.
+class QuantileSketch
+{
+public:
+    QuantileSketch(double compression = 200.0);
+
+    void add(double value, double weight);
+    void merge(const QuantileSketch & other);
+
+    double total_weight();
+    double value_with_weight_above(double weight);
+
+private:
+    struct Centroid
+    {
+        double mean;
+        double weight;
+    };
+
+    double m_compression;
+    std::vector<Centroid> m_centroids;
+    std::vector<Centroid> m_buffer;     // added values not yet merged into the centroids
+    double m_min;
+    double m_max;
+
+    void compress();
+};
+
+
+#endif // QUANTILE_SKETCH_H
@@ -16,82 +16,270 @@
 
 #include <iostream>
 #include <math.h>
+#include <algorithm>
 #include <limits>
 #include <string>
 
 #include "read.h"
 #include "misc.h"
+#include "task_pool.h"
 
-Read::Read(std::string name, char * seq, char * qscores, int length, Kmers * kmers, Arguments * args) {
+
+#define READ_CHUNK_SIZE 250000    // with reference k-mers, longer reads are scored in chunks of about this many bases
+
+
+// Gives per-base qualities straight from a read's qscores, using a lookup table instead of building a vector.
+struct QscoreQualities
+{
+    const unsigned char * qscores;
+    const double * table;
+    size_t length;
+
+    double operator[](size_t i) const {return table[qscores[i]];}
+    size_t size() const {return length;}
+};
+
+
+// Marks the bases covered by present 16-mers which end in [start, end), but only bases from start on, and finds the
+// first and last covered bases (-1 if there are none). The first may be before start, in which case the bases from it
+// up to start are left for the caller to mark. Each base is only marked once, however many k-mers cover it.
+static void mark_kmer_coverage(const char * seq, int start, int end, Kmers * kmers, unsigned char * covered,
+                               int & first_covered, int & last_covered) {
+    first_covered = -1;
+    last_covered = -1;
+    int first_end = std::max(start, 15);
+    if (first_end >= end)
+        return;
+    uint32_t kmer = kmers->starting_kmer_to_bits_forward(seq + first_end - 15);
+    int marked_to = start;
+    for (int i = first_end; i < end; ++i) {
+        if (i > first_end) {
+            kmer <<= 2;
+            kmer |= Kmers::base_to_bits_forward(seq[i]);
+        }
+        if (kmers->is_kmer_present(kmer)) {
+            if (first_covered == -1)
+                first_covered = i - 15;
+            for (int j = std::max(i - 15, marked_to); j <= i; ++j)
+                covered[j] = 1;
+            marked_to = i + 1;
+            last_covered = i + 1;
+        }
+    }
+}
+
+
+// Counts the covered bases in [start, end) and finds the fewest in any window which ends there. The window before
+// start is read too, so each chunk of a read can be counted on its own.
+static void count_kmer_coverage(const unsigned char * covered, int start, int end, int window_size, bool window,
+                                long long & covered_count, long long & min_window_count) {
+    covered_count = 0;
+    for (int i = start; i < end; ++i)
+        covered_count += covered[i];
+    min_window_count = std::numeric_limits<long long>::max();
+    int first_end = std::max(start, window_size - 1);
+    if (!window || first_end >= end)
+        return;
+    long long window_count = 0;
+    for (int i = first_end - window_size + 1; i <= first_end; ++i)
+        window_count += covered[i];
+    min_window_count = window_count;
+    for (int j = first_end + 1; j < end; ++j) {
+        window_count += covered[j] - covered[j - window_size];
+        if (window_count < min_window_count)
+            min_window_count = window_count;
+    }
+}
+
+
+template <typename Qualities>
+static double mean_quality(const Qualities & qualities) {
+    double sum = 0.0;
+    for (size_t i = 0; i < qualities.size(); ++i)
+        sum += qualities[i];
+    return 100.0 * sum / qualities.size();
+}
+
+
+// Measures a read's mean quality and, if Window is true, its window quality (the mean quality of its worst window) in
+// the same pass over the qualities. Without Window, the window loop isn't compiled in at all and the window quality is
+// just set to the mean, which leaves it out of the final score.
+template <bool Window, typename Qualities>
+static void measure_qualities(const Qualities & qualities, size_t window_size, double & mean, double & window) {
+    if (!Window || qualities.size() <= window_size) {
+        mean = mean_quality(qualities);
+        window = mean;
+        return;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < window_size; ++i)
+        sum += qualities[i];
+    double total = sum;
+    double window_quality = sum / window_size;
+    double min_window_quality = window_quality;
+
+    for (size_t j = window_size; j < qualities.size(); ++j) {
+        size_t i = j - window_size;
+        window_quality -= qualities[i] / window_size;
+        window_quality += qualities[j] / window_size;
+        total += qualities[j];
+        if (window_quality < min_window_quality)
+            min_window_quality = window_quality;
+    }
+    if (min_window_quality < 0.5 / window_size)
+        min_window_quality = 0.0;
+    mean = 100.0 * total / qualities.size();
+    window = 100.0 * min_window_quality;
+}
+
+
+static bool fails_length_thresholds(int length, Arguments * args) {
+    return (args->min_length_set && length < args->min_length) || (args->max_length_set && length > args->max_length);
+}
+
+
+// Decides which qualities matter for this read. The mean quality always does, because every read counts towards the
+// quality statistics used for normalisation. The window quality doesn't if nothing uses it (see
+// Arguments::window_quality_needed) or if the read fails a length threshold, unless failed reads' scores are shown or
+// cached. Sets skipped if the window scan is left out because the read had already failed.
+static bool window_quality_matters(int length, Arguments * args, bool & skipped) {
+    skipped = false;
+    if (!args->window_quality_needed)
+        return false;
+    if (!args->failed_read_scores_needed && fails_length_thresholds(length, args)) {
+        skipped = true;
+        return false;
+    }
+    return true;
+}
+
+
+// Measures the qualities which matter for this read. Returns whether the window scan was skipped because the read had
+// already failed.
+template <typename Qualities>
+static bool measure_read_qualities(const Qualities & qualities, int length, Arguments * args,
+                                   double & mean, double & window) {
+    bool skipped;
+    if (window_quality_matters(length, args, skipped))
+        measure_qualities<true>(qualities, args->window_size, mean, window);
+    else
+        measure_qualities<false>(qualities, args->window_size, mean, window);
+    return skipped;
+}
+
+
+// One chunk of a read's k-mer coverage, and what was found in it.
+struct CoverageChunk
+{
+    int start, end;
+    int first_covered, last_covered;
+    long long covered_count, min_window_count;
+};
+
+
+// Runs function on each chunk, in parallel if there's more than one.
+template <typename Function>
+static void for_each_chunk(std::vector<CoverageChunk> & chunks, Function function) {
+    if (chunks.size() == 1)
+        function(chunks[0]);
+    else
+        task_pool().run(SCORING, chunks.size(), [&](size_t i) {function(chunks[i]);});
+}
+
+
+// With reference k-mers, a base's quality is 1 if it's in any present 16-mer and 0 if not, so the mean and window
+// qualities come from counts of covered bases. This lets a read longer than READ_CHUNK_SIZE be split into chunks which
+// are marked, then counted, in parallel, so one ultra-long read doesn't hold up the rest. The counts add up exactly, so
+// the qualities are the same however the read is split. Returns whether the window scan was skipped because the read
+// had already failed.
+static bool measure_kmer_coverage(const char * seq, int length, Kmers * kmers, Arguments * args,
+                                  unsigned char * covered, int & first_covered, int & last_covered,
+                                  double & mean, double & window) {
+    size_t chunk_count = size_t(std::max((length + (long long)(READ_CHUNK_SIZE) - 1) / READ_CHUNK_SIZE, 1LL));
+    std::vector<CoverageChunk> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i].start = int(length * (long long)(i) / chunk_count);
+        chunks[i].end = int(length * (long long)(i + 1) / chunk_count);
+    }
+    for_each_chunk(chunks, [&](CoverageChunk & chunk) {
+        mark_kmer_coverage(seq, chunk.start, chunk.end, kmers, covered, chunk.first_covered, chunk.last_covered);
+    });
+
+    // A chunk's first k-mer can cover bases in the chunk before it, which are marked now that the chunks are done.
+    first_covered = -1;
+    last_covered = -1;
+    for (auto & chunk : chunks) {
+        if (chunk.first_covered == -1)
+            continue;
+        for (int i = chunk.first_covered; i < chunk.start; ++i)
+            covered[i] = 1;
+        if (first_covered == -1)
+            first_covered = chunk.first_covered;
+        last_covered = chunk.last_covered;
+    }
+
+    bool skipped;
+    int window_size = args->window_size;
+    bool window_matters = window_quality_matters(length, args, skipped) && length > window_size;
+    for_each_chunk(chunks, [&](CoverageChunk & chunk) {
+        count_kmer_coverage(covered, chunk.start, chunk.end, window_size, window_matters,
+                            chunk.covered_count, chunk.min_window_count);
+    });
+    long long covered_count = 0;
+    long long min_window_count = std::numeric_limits<long long>::max();
+    for (auto & chunk : chunks) {
+        covered_count += chunk.covered_count;
+        min_window_count = std::min(min_window_count, chunk.min_window_count);
+    }
+    mean = 100.0 * double(covered_count) / length;
+    window = window_matters ? 100.0 * (double(min_window_count) / window_size) : mean;
+    return skipped;
+}
+
+
+// The qscores are ASCII characters for FASTQ input (qscore_offset = 33) and raw Phred values for BAM input
+// (qscore_offset = 0).
+Read::Read(std::string name, char * seq, char * qscores, int length, Kmers * kmers, Arguments * args,
+           int qscore_offset) {
     m_name = name;
+    m_record_offset = -1;
     m_length = length;
 
     m_first_base_in_kmer = -1;
     m_last_base_in_kmer = -1;
 
-    std::vector<double> qualities;
+    std::vector<unsigned char> covered;
 
-    // If reference k-mers aren't available, use the qscores to get the qualities.
+    // If reference k-mers aren't available, use the qscores to get the qualities. These are looked up as needed, so
+    // there's no per-base vector to build.
     if (kmers->empty()) {
-        qualities.reserve(length);
-        for (int i = 0; i < length; ++i)
-            qualities.push_back(qscore_to_quality(qscores[i]));
+        QscoreQualities qscore_qualities = {reinterpret_cast<const unsigned char *>(qscores),
+                                            qscore_table(qscore_offset), size_t(length)};
+        m_window_skipped = measure_read_qualities(qscore_qualities, length, args, m_mean_quality, m_window_quality);
     }
 
     // If there are reference k-mers, use them for the qualities. A base is considered to have a quality of 1 if it
     // is in any present 16-mer, 0 if it is not.
     else {
-        qualities.resize(length, 0.0);
-        if (length >= 16) {
-            uint32_t kmer = kmers->starting_kmer_to_bits_forward(seq);
-            for (int i = 15; i < length; ++i) {
-                if (i > 15) {
-                    kmer <<= 2;
-                    kmer |= kmers->base_to_bits_forward(seq[i]);
-                }
-                if (kmers->is_kmer_present(kmer)) {
-                    for (int j = i - 15; j <= i; ++j)
-                        qualities[j] = 1.0;
-                }
-            }
-        }
+        covered.resize(length, 0);
+        m_window_skipped = measure_kmer_coverage(seq, length, kmers, args, covered.data(), m_first_base_in_kmer,
+                                                 m_last_base_in_kmer, m_mean_quality, m_window_quality);
     }
-
-    m_mean_quality = get_mean_quality(qualities);
-    m_window_quality = get_window_quality(qualities, args->window_size);
     m_length_score = get_length_score();
 
-    // See if the read failed any of the hard cut-offs.
-    m_passed = true;
-    if (args->min_length_set && m_length < args->min_length)
-        m_passed = false;
-    else if (args->max_length_set && m_length > args->max_length)
-        m_passed = false;
-    else if (args->min_mean_q_set && m_mean_quality < args->min_mean_q)
-        m_passed = false;
-    else if (args->min_window_q_set && m_window_quality < args->min_window_q)
-        m_passed = false;
+    apply_hard_thresholds(args);
 
-    m_first_base_in_kmer = -1;
-    m_last_base_in_kmer = -1;
     if (!kmers->empty()) {
-        for (int i = 0; i < length; ++i) {
-            if (qualities[i] != 0) {
-                if (m_first_base_in_kmer == -1)
-                    m_first_base_in_kmer = i;
-                m_last_base_in_kmer = i + 1;
-            }
-        }
-
         if (args->trim || args->split_set) {
 
             // Look at qualities to define 'bad ranges' of the read.
             if (args->split_set) {
                 int i = 0;
                 while (i < length) {
-                    if (qualities[i] == 0.0) {
+                    if (covered[i] == 0) {
                         int bad_start = i;
-                        while (i < length and qualities[i] == 0.0)
+                        while (i < length and covered[i] == 0)
                             ++i;
                         int bad_end = i;
                         if (bad_end - bad_start >= args->split)
@@ -135,7 +323,7 @@ Read::Read(std::string name, char * seq, char * qscores, int length, Kmers * kme
                     std::string child_name = m_name + "_" +
                             std::to_string(child_start+1) + "-" + std::to_string(child_end);
                     Read * child = new Read(child_name, seq + child_start, qscores + child_start, child_length,
-                                            kmers, args);
+                                            kmers, args, qscore_offset);
                     m_child_reads.push_back(child);
                 }
             }
@@ -144,6 +332,22 @@ Read::Read(std::string name, char * seq, char * qscores, int length, Kmers * kme
 }
 
 
+// Makes a read from scores saved in a score cache, so no sequence or qualities are needed. The caller adds any child
+// reads and ranges.
+Read::Read(std::string name, int length, double mean_quality, double window_quality, Arguments * args) {
+    m_name = name;
+    m_record_offset = -1;
+    m_length = length;
+    m_first_base_in_kmer = -1;
+    m_last_base_in_kmer = -1;
+    m_mean_quality = mean_quality;
+    m_window_quality = window_quality;
+    m_window_skipped = false;
+    m_length_score = get_length_score();
+    apply_hard_thresholds(args);
+}
+
+
 Read::~Read() {
     for (auto child : m_child_reads)
         delete child;
@@ -205,36 +409,19 @@ void Read::print_scores(size_t name_length) {
 }
 
 
-double Read::get_mean_quality(std::vector<double> & qualities) {
-    double sum = 0.0;
-    for (auto q : qualities)
-        sum += q;
-    return 100.0 * sum / qualities.size();
+// See if the read failed any of the hard cut-offs. Targets are applied later, once all reads are scored.
+void Read::apply_hard_thresholds(Arguments * args) {
+    m_passed = true;
+    m_target_mask = ~uint64_t(0);
+    if (fails_length_thresholds(m_length, args))
+        m_passed = false;
+    else if (args->min_mean_q_set && m_mean_quality < args->min_mean_q)
+        m_passed = false;
+    else if (args->min_window_q_set && m_window_quality < args->min_window_q)
+        m_passed = false;
 }
 
 
-double Read::get_window_quality(std::vector<double> & qualities, size_t window_size) {
-    if (qualities.size() <= window_size)
-        return get_mean_quality(qualities);
-
-    double sum = 0.0;
-    for (size_t i = 0; i < window_size; ++i)
-        sum += qualities[i];
-    double window_quality = sum / window_size;
-    double min_window_quality = window_quality;
-
-    for (size_t j = window_size; j < qualities.size(); ++j) {
-        size_t i = j - window_size;
-        window_quality -= qualities[i] / window_size;
-        window_quality += qualities[j] / window_size;
-        if (window_quality < min_window_quality)
-            min_window_quality = window_quality;
-    }
-    if (min_window_quality < 0.5 / window_size)
-        min_window_quality = 0.0;
-    return 100.0 * min_window_quality;
-}
-
 // At the moment, the half-score length is hard-coded to 5 kbp. Maybe this should be adjustable via a setting?
 // https://www.desmos.com/calculator
 // y=100\left(1+\frac{-a}{x+a}\right)
@@ -267,7 +454,22 @@ void Read::set_final_score(double length_weight, double mean_q_weight, double wi
 }
 
 
-double Read::qscore_to_quality(char qscore) {
-    int q = qscore - 33;
+double Read::qscore_to_quality(int q) {
     return 1.0 - pow(10.0, -q / 10.0);
 }
+
+
+// Qualities for every possible qscore byte, for FASTQ (offset 33) and BAM (offset 0) qscores.
+const double * Read::qscore_table(int qscore_offset) {
+    struct Table
+    {
+        double values[256];
+        Table(int offset) {
+            for (int i = 0; i < 256; ++i)
+                values[i] = qscore_to_quality(int(char(i)) - offset);
+        }
+    };
+    static const Table fastq_table(33);
+    static const Table bam_table(0);
+    return (qscore_offset == 0) ? bam_table.values : fastq_table.values;
+}
@@ -21,6 +21,7 @@
 #include <unordered_set>
 #include <utility>
 #include <tuple>
+#include <cstdint>
 
 #include "kmers.h"
 #include "arguments.h"
@@ -29,7 +30,9 @@
 class Read
 {
 public:
-    Read(std::string name, char * seq, char * qscores, int length, Kmers * kmers, Arguments * args);
+    Read(std::string name, char * seq, char * qscores, int length, Kmers * kmers, Arguments * args,
+         int qscore_offset);
+    Read(std::string name, int length, double mean_quality, double window_quality, Arguments * args);
     ~Read();
 
     void print_verbose_read_info();
@@ -38,15 +41,20 @@ public:
     void set_final_score(double length_weight, double mean_q_weight, double window_q_weight);
 
     std::string m_name;
+    long long m_record_offset;    // where the read's record starts in its file (a virtual offset for BAM input)
 
     int m_length;
     double m_length_score;
 
     double m_mean_quality;
     double m_window_quality;
+    bool m_window_skipped;        // the read failed a length threshold, so its window quality wasn't measured
 
     double m_final_score;
     bool m_passed;
+    uint64_t m_target_mask;       // with multiple targets, bit i is cleared if target i doesn't keep the read
+
+    bool passed_for_target(size_t target) {return m_passed && ((m_target_mask >> target) & 1) != 0;}
 
     int m_first_base_in_kmer;
     int m_last_base_in_kmer;
@@ -56,12 +64,11 @@ public:
     std::vector<std::pair<int,int> > m_child_read_ranges;
 
 private:
-    double get_mean_quality(std::vector<double> & qualities);
-    double get_window_quality(std::vector<double> & qualities, size_t window_size);
-
+    void apply_hard_thresholds(Arguments * args);
     double get_length_score();
 
-    double qscore_to_quality(char qscore);
+    static double qscore_to_quality(int q);
+    static const double * qscore_table(int qscore_offset);
 };
 
 
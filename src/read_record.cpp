@@ -0,0 +1,70 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include "read_record.h"
+
+
+void save_read(CacheWriter & writer, Read * read) {
+    writer.string(read->m_name);
+    writer.value(int32_t(read->m_length));
+    writer.value(read->m_mean_quality);
+    writer.value(read->m_window_quality);
+    writer.value(int64_t(read->m_record_offset));
+    writer.value(uint32_t(read->m_bad_ranges.size()));
+    for (auto & range : read->m_bad_ranges) {
+        writer.value(int32_t(range.first));
+        writer.value(int32_t(range.second));
+    }
+    writer.value(uint32_t(read->m_child_reads.size()));
+    for (size_t i = 0; i < read->m_child_reads.size(); ++i) {
+        writer.value(int32_t(read->m_child_read_ranges[i].first));
+        writer.value(int32_t(read->m_child_read_ranges[i].second));
+        save_read(writer, read->m_child_reads[i]);
+    }
+}
+
+
+Read * load_read(CacheReader & reader, Arguments * args) {
+    std::string name = reader.string();
+    int length = reader.value<int32_t>();
+    double mean_quality = reader.value<double>();
+    double window_quality = reader.value<double>();
+    long long record_offset = reader.value<int64_t>();
+    if (!reader.ok())
+        return NULL;
+    Read * read = new Read(name, length, mean_quality, window_quality, args);
+    read->m_record_offset = record_offset;
+    uint32_t bad_range_count = reader.value<uint32_t>();
+    for (uint32_t i = 0; i < bad_range_count && reader.ok(); ++i) {
+        int start = reader.value<int32_t>();
+        int end = reader.value<int32_t>();
+        read->m_bad_ranges.push_back(std::pair<int,int>(start, end));
+    }
+    uint32_t child_count = reader.value<uint32_t>();
+    for (uint32_t i = 0; i < child_count && reader.ok(); ++i) {
+        int start = reader.value<int32_t>();
+        int end = reader.value<int32_t>();
+        Read * child = load_read(reader, args);
+        if (child == NULL)
+            break;
+        read->m_child_read_ranges.push_back(std::pair<int,int>(start, end));
+        read->m_child_reads.push_back(child);
+    }
+    if (!reader.ok()) {
+        delete read;
+        return NULL;
+    }
+    return read;
+}
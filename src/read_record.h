@@ -0,0 +1,85 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef READ_RECORD_H
+#define READ_RECORD_H
+
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "arguments.h"
+#include "read.h"
+
+
+// Values are written in the machine's native byte order. A cache is meant to be reused on the machine (or at least
+// the kind of machine) which made it.
+class CacheWriter
+{
+public:
+    CacheWriter(FILE * file) : m_file(file), m_ok(true) {}
+
+    template <typename T> void value(T v) {
+        m_ok = m_ok && fwrite(&v, sizeof(T), 1, m_file) == 1;
+    }
+    void bytes(const void * data, size_t length) {
+        value(uint64_t(length));
+        m_ok = m_ok && (length == 0 || fwrite(data, 1, length, m_file) == length);
+    }
+    void string(const std::string & s) {bytes(s.data(), s.size());}
+    bool ok() {return m_ok;}
+
+private:
+    FILE * m_file;
+    bool m_ok;
+};
+
+
+class CacheReader
+{
+public:
+    CacheReader(FILE * file) : m_file(file), m_ok(true) {}
+
+    template <typename T> T value() {
+        T v = T();
+        m_ok = m_ok && fread(&v, sizeof(T), 1, m_file) == 1;
+        return v;
+    }
+    std::string string() {
+        uint64_t length = value<uint64_t>();
+        if (!m_ok || length > (uint64_t(1) << 32)) {
+            m_ok = false;
+            return "";
+        }
+        std::string s(length, '\0');
+        m_ok = (length == 0 || fread(&s[0], 1, length, m_file) == length);
+        return s;
+    }
+    bool ok() {return m_ok;}
+
+private:
+    FILE * m_file;
+    bool m_ok;
+};
+
+
+// A read's record holds its raw scores, bad ranges, record offset and (recursively) its child reads. These are used by
+// the score cache and by the spill files of --memory_budget.
+void save_read(CacheWriter & writer, Read * read);
+Read * load_read(CacheReader & reader, Arguments * args);
+
+
+#endif // READ_RECORD_H
@@ -0,0 +1,127 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "score_cache.h"
+#include "read_record.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/stat.h>
+
+
+#define SCORE_CACHE_MAGIC "FLSCORE1"
+
+
+static void describe_file(std::ostringstream & fingerprint, const std::string & filename) {
+    struct stat file_stat;
+    fingerprint << filename;
+    if (stat(filename.c_str(), &file_stat) == 0)
+        fingerprint << "\t" << (long long)(file_stat.st_size) << "\t" << (long long)(file_stat.st_mtime);
+    fingerprint << "\n";
+}
+
+
+std::string score_cache_fingerprint(Arguments & args) {
+    std::ostringstream fingerprint;
+    fingerprint << "inputs:\n";
+    for (auto & filename : args.input_reads)
+        describe_file(fingerprint, filename);
+    fingerprint << "references:\n";
+    if (args.assembly_set)
+        describe_file(fingerprint, args.assembly);
+    for (auto & filename : args.short_reads)
+        describe_file(fingerprint, filename);
+    fingerprint << "window_size: " << args.window_size << "\n";
+    fingerprint << "trim: " << args.trim << "\n";
+    fingerprint << "split: " << (args.split_set ? args.split : 0) << "\n";
+    return fingerprint.str();
+}
+
+
+// Fills in the inputs from the cache file. Returns false (leaving the inputs empty) if the file doesn't exist, isn't a
+// score cache or was made from different input/settings.
+bool load_score_cache(std::string filename, std::string fingerprint, Arguments * args,
+                      std::vector<ScoredInput> & inputs) {
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    CacheReader reader(file);
+
+    char magic[8];
+    bool ok = (fread(magic, 1, 8, file) == 8 && memcmp(magic, SCORE_CACHE_MAGIC, 8) == 0);
+    ok = ok && reader.string() == fingerprint;
+    ok = ok && reader.value<uint32_t>() == inputs.size();
+    for (size_t i = 0; ok && i < inputs.size(); ++i) {
+        ScoredInput & input = inputs[i];
+        ok = (reader.string() == input.filename);
+        input.total_bases = reader.value<int64_t>();
+        uint8_t flags = reader.value<uint8_t>();
+        input.any_fasta = (flags & 1) != 0;
+        input.any_fastq = (flags & 2) != 0;
+        input.bam = (flags & 4) != 0;
+        input.bam_header_text = reader.string();
+        std::string references = reader.string();
+        input.bam_references.assign(references.begin(), references.end());
+        uint64_t read_count = reader.value<uint64_t>();
+        for (uint64_t j = 0; ok && reader.ok() && j < read_count; ++j) {
+            Read * read = load_read(reader, args);
+            if (read == NULL)
+                break;
+            input.add_read(read);
+        }
+        ok = ok && reader.ok() && input.reads.size() == read_count;
+    }
+    fclose(file);
+
+    if (!ok) {
+        for (auto & input : inputs) {
+            for (auto read : input.reads)
+                delete read;
+            input.reads.clear();
+            input.quality_stats = QualityStats();
+        }
+    }
+    return ok;
+}
+
+
+bool save_score_cache(std::string filename, std::string fingerprint, std::vector<ScoredInput> & inputs) {
+    FILE * file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    CacheWriter writer(file);
+
+    fwrite(SCORE_CACHE_MAGIC, 1, 8, file);
+    writer.string(fingerprint);
+    writer.value(uint32_t(inputs.size()));
+    for (auto & input : inputs) {
+        writer.string(input.filename);
+        writer.value(int64_t(input.total_bases));
+        writer.value(uint8_t((input.any_fasta ? 1 : 0) | (input.any_fastq ? 2 : 0) | (input.bam ? 4 : 0)));
+        writer.string(input.bam_header_text);
+        writer.bytes(input.bam_references.data(), input.bam_references.size());
+        writer.value(uint64_t(input.reads.size()));
+        for (auto read : input.reads)
+            save_read(writer, read);
+    }
+    bool ok = writer.ok();
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
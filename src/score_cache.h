@@ -0,0 +1,38 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef SCORE_CACHE_H
+#define SCORE_CACHE_H
+
+
+#include <string>
+#include <vector>
+
+#include "arguments.h"
+#include "scored_input.h"
+
+
+// A score cache is a binary file holding each read's raw scores (length, mean quality and window quality), child
+// ranges and record offset, so a later run on the same input can skip scoring. It's keyed by a fingerprint of the
+// input files and every setting that affects the raw scores. Settings that are applied afterwards (thresholds, weights,
+// targets) aren't part of the fingerprint, so they can be changed freely between runs.
+
+std::string score_cache_fingerprint(Arguments & args);
+bool load_score_cache(std::string filename, std::string fingerprint, Arguments * args,
+                      std::vector<ScoredInput> & inputs);
+bool save_score_cache(std::string filename, std::string fingerprint, std::vector<ScoredInput> & inputs);
+
+
+#endif // SCORE_CACHE_H
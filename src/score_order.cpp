@@ -0,0 +1,67 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "score_order.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+#include "spill_file.h"
+
+
+ScoreOrder::ScoreOrder(const std::string & temp_dir, int threads) :
+    m_temp_dir(temp_dir), m_threads(threads), m_stage_file(NULL) {
+}
+
+
+ScoreOrder::~ScoreOrder() {
+    m_stage.reset();
+    if (m_stage_file != NULL)
+        fclose(m_stage_file);
+}
+
+
+bool ScoreOrder::open_stage() {
+    m_stage_file = open_temp_file(m_temp_dir);
+    if (m_stage_file == NULL)
+        return false;
+    m_stage.reset(new OutputWriter(fileno(m_stage_file), false));
+    return true;
+}
+
+
+// Reads a staged record's text back from the staging file.
+bool ScoreOrder::fetch_staged(const OrderedRecord & record, std::string & text) {
+    if (!m_stage->flush())
+        return false;
+    text.resize(size_t(record.size));
+    size_t done = 0;
+    while (done < text.size()) {
+        ssize_t n = pread(fileno(m_stage_file), &text[done], text.size() - done, off_t(record.offset + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += size_t(n);
+    }
+    return true;
+}
+
+
+void ScoreOrder::add(const OrderedRecord & record, double score, int bases) {
+    m_ranking.push_back(make_scored_read(score, m_records.size(), bases));
+    m_records.push_back(record);
+}
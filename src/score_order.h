@@ -0,0 +1,111 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#ifndef SCORE_ORDER_H
+#define SCORE_ORDER_H
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "output_writer.h"
+#include "read.h"
+#include "selection.h"
+
+
+#define SCORE_ORDER_BATCH_BYTES (64 << 20)
+
+
+// One output record for --output_order score: a read, or a child read of a trimmed/split read.
+struct OrderedRecord
+{
+    Read * read;          // the read, or for a child read, its parent
+    int child;            // which child read, or -1 for the whole read
+    uint64_t targets;     // bit i is set if target i outputs the record
+    uint32_t input;       // which input file it's fetched from
+    long long offset;     // where it's fetched from: the staging file or its BAM input (a virtual offset)
+    long long size;       // about how many bytes fetching it takes
+};
+
+
+// --output_order score writes each output's reads best first, rather than in input order. The output pass adds each
+// output record with its score, and for FASTQ/FASTA input it also formats the record into a staging file (an unlinked
+// temporary file, as used by --memory_budget), since gzipped input can't be read at random. The records are then
+// ranked as for the targets (best first, ties to the record which came first) and written in batches: each batch
+// takes the next best records up to SCORE_ORDER_BATCH_BYTES, fetches them in file order so reading stays close to
+// sequential, and then writes them out best first.
+class ScoreOrder
+{
+public:
+    ScoreOrder(const std::string & temp_dir, int threads);
+    ~ScoreOrder();
+
+    bool open_stage();
+    OutputWriter & stage() {return *m_stage;}
+    bool fetch_staged(const OrderedRecord & record, std::string & text);
+
+    void add(const OrderedRecord & record, double score, int bases);
+
+    // Calls fetch(record, slot) for each record of a batch in file order, then emit(record, slot, bases) for each in
+    // score order, where slot is the record's place in the batch. Returns false if a fetch fails.
+    template <typename Fetch, typename Emit>
+    bool write_best_first(Fetch fetch, Emit emit) {
+        sort_best_first(m_ranking, m_threads);
+        std::vector<size_t> batch;
+        std::vector<size_t> file_order;
+        size_t next = 0;
+        while (next < m_ranking.size()) {
+            batch.clear();
+            long long batch_bytes = 0;
+            while (next < m_ranking.size() && (batch.empty() || batch_bytes < SCORE_ORDER_BATCH_BYTES)) {
+                batch.push_back(next);
+                batch_bytes += m_records[m_ranking[next++].index].size;
+            }
+            file_order.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i)
+                file_order[i] = i;
+            std::sort(file_order.begin(), file_order.end(), [&](size_t a, size_t b) {
+                const OrderedRecord & x = m_records[m_ranking[batch[a]].index];
+                const OrderedRecord & y = m_records[m_ranking[batch[b]].index];
+                return x.input != y.input ? x.input < y.input : x.offset < y.offset;
+            });
+            for (size_t slot : file_order) {
+                if (!fetch(m_records[m_ranking[batch[slot]].index], slot))
+                    return false;
+            }
+            for (size_t slot = 0; slot < batch.size(); ++slot) {
+                const ScoredRead & ranked = m_ranking[batch[slot]];
+                emit(m_records[ranked.index], slot, ranked.length);
+            }
+        }
+        return true;
+    }
+
+private:
+    std::string m_temp_dir;
+    int m_threads;
+    std::vector<OrderedRecord> m_records;
+    std::vector<ScoredRead> m_ranking;
+    FILE * m_stage_file;
+    std::unique_ptr<OutputWriter> m_stage;
+};
+
+
+#endif // SCORE_ORDER_H
@@ -0,0 +1,94 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "score_table.h"
+
+#include "misc.h"
+
+
+#define SCORE_TABLE_DECIMALS 4
+
+
+ScoreTable::ScoreTable(const std::string & filename, int compression_level) :
+    m_out(OutputWriter::open(filename, compression_level, 1)), m_target_count(0) {
+}
+
+
+ScoreTable::~ScoreTable() {
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void ScoreTable::start(const std::vector<Read *> & reads, std::vector<std::pair<double,double>> raw_qualities,
+                       size_t target_count) {
+    m_reads = reads;
+    m_raw_qualities.swap(raw_qualities);
+    m_target_count = target_count;
+    m_thread = std::thread(&ScoreTable::write_table, this);
+}
+
+
+// Waits for the table to be written. Returns false if it couldn't be.
+bool ScoreTable::finish() {
+    if (m_thread.joinable())
+        m_thread.join();
+    return m_out->close();
+}
+
+
+void ScoreTable::write_table() {
+    m_out->write("name\tparent\tstart\tend\tlength\tmean_quality\twindow_quality\tlength_score\tmean_quality_score\t"
+                 "window_quality_score\tfinal_score\tpassed\tkept\n");
+    std::string row;
+    size_t leaf_index = 0;
+    for (auto read : m_reads) {
+        if (read->m_child_reads.size() == 0) {
+            write_row(row, read, read->m_name, 0, read->m_length, m_raw_qualities[leaf_index++]);
+            continue;
+        }
+        for (size_t i = 0; i < read->m_child_reads.size(); ++i)
+            write_row(row, read->m_child_reads[i], read->m_name, read->m_child_read_ranges[i].first,
+                      read->m_child_read_ranges[i].second, m_raw_qualities[leaf_index++]);
+    }
+}
+
+
+void ScoreTable::write_row(std::string & row, Read * read, const std::string & parent, int start, int end,
+                           std::pair<double,double> raw_qualities) {
+    row.clear();
+    row += read->m_name;
+    row += '\t';
+    row += parent;
+    row += '\t';
+    append_integer(row, start);
+    row += '\t';
+    append_integer(row, end);
+    row += '\t';
+    append_integer(row, read->m_length);
+    for (double score : {raw_qualities.first, raw_qualities.second, read->m_length_score, read->m_mean_quality,
+                         read->m_window_quality, read->m_final_score}) {
+        row += '\t';
+        append_fixed(row, score, SCORE_TABLE_DECIMALS);
+    }
+    row += '\t';
+    row += read->m_passed ? '1' : '0';
+    row += '\t';
+    for (size_t target = 0; target < m_target_count; ++target)
+        row += read->passed_for_target(target) ? '1' : '0';
+    row += '\n';
+    m_out->write(row);
+}
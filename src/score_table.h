@@ -0,0 +1,63 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#ifndef SCORE_TABLE_H
+#define SCORE_TABLE_H
+
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "output_writer.h"
+#include "read.h"
+
+
+// Writes --scores_out: a tab-separated table with a row for each read, or for each child read of a trimmed/split read.
+// A row gives the read's parent and range in it (for an ordinary read, itself and the whole read), its length, raw
+// mean and window qualities, its scores after normalisation, whether it passed the thresholds and which targets kept
+// it. Numbers are formatted without iostreams, and the table is written on a background thread, so it overlaps with
+// the output pass.
+class ScoreTable
+{
+public:
+    ScoreTable(const std::string & filename, int compression_level);
+    ~ScoreTable();
+
+    bool is_open() {return m_out != NULL;}
+
+    // Starts writing the table. The raw qualities (mean, window) line up with the reads' leaf reads, saved from before
+    // they were normalised. The reads must not change until finish is called.
+    void start(const std::vector<Read *> & reads, std::vector<std::pair<double,double>> raw_qualities,
+               size_t target_count);
+    bool finish();
+
+private:
+    std::unique_ptr<OutputWriter> m_out;
+    std::vector<Read *> m_reads;
+    std::vector<std::pair<double,double>> m_raw_qualities;
+    size_t m_target_count;
+    std::thread m_thread;
+
+    void write_table();
+    void write_row(std::string & row, Read * read, const std::string & parent, int start, int end,
+                   std::pair<double,double> raw_qualities);
+};
+
+
+#endif // SCORE_TABLE_H
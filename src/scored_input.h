@@ -0,0 +1,75 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef SCORED_INPUT_H
+#define SCORED_INPUT_H
+
+
+#include <string>
+#include <vector>
+
+#include "read.h"
+#include "quality_stats.h"
+#include "spill_file.h"
+
+
+// The reads from one input file, along with what was learned about the file while scoring it.
+struct ScoredInput
+{
+    std::string filename;
+    std::vector<Read*> reads;
+    QualityStats quality_stats;     // of the reads which will be output: child reads if a read was trimmed/split
+    long long total_bases = 0;
+    bool any_fasta = false;
+    bool any_fastq = false;
+    std::string error;
+
+    bool bam = false;
+    std::string bam_header_text;
+    std::vector<unsigned char> bam_references;
+
+    // With --memory_budget, reads go to the spill file instead of the list (see SpillFile).
+    SpillFile * spill = NULL;
+
+    // Reads (including child reads) which failed a length threshold, so their window quality wasn't measured.
+    long long window_skipped_reads = 0;
+    long long window_skipped_bases = 0;
+
+    void add_read(Read * read) {
+        count_window_skipped(read);
+        for (auto child : read->m_child_reads)
+            count_window_skipped(child);
+        if (read->m_child_reads.size() == 0)
+            quality_stats.add(read->m_mean_quality);
+        for (auto child : read->m_child_reads)
+            quality_stats.add(child->m_mean_quality);
+        if (spill == NULL) {
+            reads.push_back(read);
+            return;
+        }
+        spill->write(read);
+        delete read;
+    }
+
+    void count_window_skipped(Read * read) {
+        if (read->m_window_skipped) {
+            ++window_skipped_reads;
+            window_skipped_bases += read->m_length;
+        }
+    }
+};
+
+
+#endif // SCORED_INPUT_H
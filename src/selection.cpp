@@ -0,0 +1,323 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+
+#include "selection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+#include "task_pool.h"
+
+
+#define SELECTION_SORT_SIZE 64        // ranges this small are just sorted
+#define HISTOGRAM_BINS 1024
+#define HISTOGRAM_COLLECT_LIMIT 65536  // boundary bins with this many reads or fewer are resolved exactly
+#define RADIX_SORT_MIN_READS 256      // fewer reads than this are sorted with std::sort
+#define RADIX_BITS 13                 // five passes over a 64-bit score key
+#define RADIX_THREAD_MIN_READS 65536  // each sorting thread gets at least this many reads
+
+
+// A NaN score (which happens when every read has the same quality) can't be ranked, so it's treated as the worst
+// possible score.
+ScoredRead make_scored_read(double score, size_t index, int length) {
+    ScoredRead read;
+    read.score = std::isnan(score) ? -std::numeric_limits<double>::infinity() : score;
+    read.index = uint32_t(index);
+    read.length = int32_t(length);
+    return read;
+}
+
+
+// Rearranges the reads so the best ones come first, stopping at the first read which brings the total to the target.
+// Returns how many reads that is (all of them if the target can't be reached) and sets kept_bases to their total.
+// This is a quickselect weighted by bases: each step partitions the remaining range around its middle read and only
+// carries on into the side holding the cut-off, so it takes expected linear time rather than a full sort. Only the
+// final small range is sorted. The kept reads are the same as the best-first prefix of a full sort.
+size_t select_best_reads(std::vector<ScoredRead> & reads, long long target_bases, long long & kept_bases) {
+    size_t begin = 0, end = reads.size();
+    long long remaining = target_bases;
+    kept_bases = 0;
+    while (end - begin > SELECTION_SORT_SIZE) {
+        size_t middle = begin + (end - begin) / 2;
+        std::nth_element(reads.begin() + begin, reads.begin() + middle, reads.begin() + end, better_read);
+        long long left_bases = 0;
+        for (size_t i = begin; i < middle; ++i)
+            left_bases += reads[i].length;
+        if (left_bases >= remaining) {
+            end = middle;
+            continue;
+        }
+        remaining -= left_bases;
+        kept_bases += left_bases;
+        remaining -= reads[middle].length;
+        kept_bases += reads[middle].length;
+        if (remaining <= 0)
+            return middle + 1;
+        begin = middle + 1;
+    }
+    std::sort(reads.begin() + begin, reads.begin() + end, better_read);
+    for (size_t i = begin; i < end; ++i) {
+        if (remaining <= 0)
+            return i;
+        remaining -= reads[i].length;
+        kept_bases += reads[i].length;
+    }
+    return end;
+}
+
+
+// Maps a score to an integer which sorts in the same order, with NaN (like in make_scored_read) lowest of all. Working
+// with these keys means the histogram bins can always split a range of scores, however narrow or wide it is.
+uint64_t score_key(double score) {
+    if (std::isnan(score))
+        score = -std::numeric_limits<double>::infinity();
+    if (score == 0.0)
+        score = 0.0;    // -0.0 and 0.0 are equal scores, so they get the same key
+    uint64_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return (bits & 0x8000000000000000ULL) ? ~bits : (bits | 0x8000000000000000ULL);
+}
+
+
+static double key_to_score(uint64_t key) {
+    uint64_t bits = (key & 0x8000000000000000ULL) ? (key & ~0x8000000000000000ULL) : ~key;
+    double score;
+    memcpy(&score, &bits, sizeof(score));
+    return score;
+}
+
+
+// A read for radix sorting, with its score replaced by a key that sorts best first.
+struct RadixRead
+{
+    uint64_t key;
+    uint32_t index;
+    int32_t length;
+};
+
+
+// One pass of an LSD radix sort: moves the reads from source to destination, ordered by RADIX_BITS bits of their
+// keys (starting at shift) and otherwise keeping their order. Each thread counts and then moves its own share of the
+// reads, with the shares' places in each bucket following their order, so the pass is still stable when parallel.
+static void radix_pass(const std::vector<RadixRead> & source, std::vector<RadixRead> & destination, bool by_index,
+                       int shift, size_t thread_count) {
+    const uint64_t mask = (uint64_t(1) << RADIX_BITS) - 1;
+    size_t share = (source.size() + thread_count - 1) / thread_count;
+    std::vector<std::vector<size_t>> positions(thread_count, std::vector<size_t>(mask + 1, 0));
+    auto run_threads = [&](std::function<void(size_t, size_t, size_t)> work) {
+        task_pool().run(SORTING, thread_count, [&](size_t t) {
+            work(t, std::min(source.size(), t * share), std::min(source.size(), (t + 1) * share));
+        });
+    };
+    run_threads([&](size_t t, size_t begin, size_t end) {
+        std::vector<size_t> & counts = positions[t];
+        for (size_t i = begin; i < end; ++i)
+            ++counts[((by_index ? source[i].index : source[i].key) >> shift) & mask];
+    });
+    size_t position = 0;
+    for (size_t d = 0; d <= mask; ++d) {
+        for (size_t t = 0; t < thread_count; ++t) {
+            size_t count = positions[t][d];
+            positions[t][d] = position;
+            position += count;
+        }
+    }
+    run_threads([&](size_t t, size_t begin, size_t end) {
+        std::vector<size_t> & next = positions[t];
+        for (size_t i = begin; i < end; ++i)
+            destination[next[((by_index ? source[i].index : source[i].key) >> shift) & mask]++] = source[i];
+    });
+}
+
+
+// Sorts the reads best first (the same order as better_read) with an LSD radix sort over their score keys, in up to
+// the given number of threads. If the reads aren't already in index order, they're first sorted by index, which the
+// score passes then keep for tied scores. Passes where every read has the same digit are skipped, which is usually
+// true of the high bits (the sign and exponent).
+void sort_best_first(std::vector<ScoredRead> & reads, int threads) {
+    if (reads.size() < RADIX_SORT_MIN_READS) {
+        std::sort(reads.begin(), reads.end(), better_read);
+        return;
+    }
+    size_t thread_count = std::max(size_t(1), std::min(size_t(threads), reads.size() / RADIX_THREAD_MIN_READS));
+
+    // Keys are flipped so higher scores come first.
+    std::vector<RadixRead> radix_reads(reads.size()), buffer(reads.size());
+    uint64_t all_keys_and = std::numeric_limits<uint64_t>::max(), all_keys_or = 0;
+    bool index_order = true;
+    for (size_t i = 0; i < reads.size(); ++i) {
+        RadixRead & read = radix_reads[i];
+        read.key = ~score_key(reads[i].score);
+        read.index = reads[i].index;
+        read.length = reads[i].length;
+        all_keys_and &= read.key;
+        all_keys_or |= read.key;
+        index_order = index_order && (i == 0 || reads[i - 1].index < read.index);
+    }
+    for (int shift = 0; shift < 32 && !index_order; shift += RADIX_BITS) {
+        radix_pass(radix_reads, buffer, true, shift, thread_count);
+        radix_reads.swap(buffer);
+    }
+    for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+        if ((((all_keys_and ^ all_keys_or) >> shift) & ((uint64_t(1) << RADIX_BITS) - 1)) == 0)
+            continue;
+        radix_pass(radix_reads, buffer, false, shift, thread_count);
+        radix_reads.swap(buffer);
+    }
+    std::vector<RadixRead>().swap(buffer);
+
+    for (size_t i = 0; i < reads.size(); ++i) {
+        reads[i].score = key_to_score(~radix_reads[i].key);
+        reads[i].index = radix_reads[i].index;
+        reads[i].length = radix_reads[i].length;
+    }
+}
+
+
+HistogramSelector::HistogramSelector(long long target_bases) {
+    m_stage = (target_bases > 0) ? HISTOGRAM : DONE;
+    m_first_pass = true;
+    m_remaining = target_bases;
+    m_kept_bases = 0;
+    m_low = 0;
+    m_high = std::numeric_limits<uint64_t>::max();
+    m_range_count = std::numeric_limits<uint32_t>::max();
+    m_keep_all = false;
+    m_has_cut = false;
+    m_cut_key = 0;
+    m_cut_index = 0;
+    set_up_bins(false);
+}
+
+
+void HistogramSelector::add(double score, uint32_t index, int length) {
+    uint64_t key = score_key(score);
+    if (key < m_low || key > m_high)
+        return;
+    if (m_stage == HISTOGRAM) {
+        size_t bin;
+        if (m_value_bins)
+            bin = std::min(size_t((score - m_low_value) * m_bin_scale), size_t(HISTOGRAM_BINS - 1));
+        else
+            bin = size_t((key - m_low) >> m_shift);
+        m_bin_bases[bin] += length;
+        ++m_bin_counts[bin];
+        m_bin_low[bin] = std::min(m_bin_low[bin], key);
+        m_bin_high[bin] = std::max(m_bin_high[bin], key);
+    }
+    else if (m_stage == COLLECT) {
+        m_collected.push_back(make_scored_read(score, index, length));
+    }
+    else if (m_stage == TIES && m_remaining > 0) {
+        // Reads come in index order, so the earliest tied reads are the ones kept.
+        m_remaining -= length;
+        m_kept_bases += length;
+        m_has_cut = true;
+        m_cut_key = key;
+        m_cut_index = index;
+    }
+}
+
+
+void HistogramSelector::finish_pass() {
+    if (m_stage == HISTOGRAM) {
+        if (m_first_pass) {
+            m_first_pass = false;
+            long long total_bases = 0;
+            for (auto bases : m_bin_bases)
+                total_bases += bases;
+            if (total_bases <= m_remaining) {
+                m_keep_all = true;
+                m_kept_bases = total_bases;
+                m_stage = DONE;
+                return;
+            }
+        }
+
+        // Reads in bins above the one where the target is reached are all kept, and reads below it all fail.
+        size_t bin = HISTOGRAM_BINS - 1;
+        while (bin > 0 && m_bin_bases[bin] < m_remaining) {
+            m_remaining -= m_bin_bases[bin];
+            m_kept_bases += m_bin_bases[bin];
+            --bin;
+        }
+        uint32_t previous_count = m_range_count;
+        m_low = m_bin_low[bin];
+        m_high = m_bin_high[bin];
+        m_range_count = m_bin_counts[bin];
+
+        // Even value bins suit the usual spread of scores, but if they did a poor job of splitting the range (it kept
+        // over half of its reads) the next pass splits the keys instead, which always narrows the range.
+        double low_value = key_to_score(m_low), high_value = key_to_score(m_high);
+        bool value_bins = std::isfinite(low_value) && std::isfinite(high_value) &&
+                          std::isfinite(high_value - low_value) &&
+                          (m_first_pass || m_range_count <= previous_count / 2);
+        if (m_low == m_high)
+            m_stage = TIES;
+        else if (m_range_count <= HISTOGRAM_COLLECT_LIMIT)
+            m_stage = COLLECT;
+        else
+            set_up_bins(value_bins);
+        if (m_stage != HISTOGRAM) {
+            std::vector<long long>().swap(m_bin_bases);
+            std::vector<uint32_t>().swap(m_bin_counts);
+            std::vector<uint64_t>().swap(m_bin_low);
+            std::vector<uint64_t>().swap(m_bin_high);
+        }
+    }
+    else if (m_stage == COLLECT) {
+        long long collected_kept_bases;
+        size_t kept_count = select_best_reads(m_collected, m_remaining, collected_kept_bases);
+        m_kept_bases += collected_kept_bases;
+        m_has_cut = true;
+        m_cut_key = score_key(m_collected[kept_count - 1].score);
+        m_cut_index = m_collected[kept_count - 1].index;
+        std::vector<ScoredRead>().swap(m_collected);
+        m_stage = DONE;
+    }
+    else if (m_stage == TIES) {
+        m_stage = DONE;
+    }
+}
+
+
+// Sets up the bins for the next pass over [m_low, m_high], which holds at least m_remaining bases. The first pass
+// covers every possible key, and its bins split them by the top bits: the sign and most of the exponent.
+void HistogramSelector::set_up_bins(bool value_bins) {
+    m_value_bins = value_bins;
+    m_low_value = key_to_score(m_low);
+    m_bin_scale = value_bins ? HISTOGRAM_BINS / (key_to_score(m_high) - m_low_value) : 0.0;
+    m_shift = 0;
+    while (((m_high - m_low) >> m_shift) >= HISTOGRAM_BINS)
+        ++m_shift;
+    m_bin_bases.assign(HISTOGRAM_BINS, 0);
+    m_bin_counts.assign(HISTOGRAM_BINS, 0);
+    m_bin_low.assign(HISTOGRAM_BINS, std::numeric_limits<uint64_t>::max());
+    m_bin_high.assign(HISTOGRAM_BINS, 0);
+}
+
+
+bool HistogramSelector::keep(double score, uint32_t index) {
+    if (m_keep_all)
+        return true;
+    if (!m_has_cut)
+        return false;
+    uint64_t key = score_key(score);
+    return key > m_cut_key || (key == m_cut_key && index <= m_cut_index);
+}
@@ -0,0 +1,106 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef SELECTION_H
+#define SELECTION_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// A read's final score, packed with its length and its index in the caller's read list, so choosing reads by score
+// doesn't need to touch the Read objects.
+struct ScoredRead
+{
+    double score;
+    uint32_t index;
+    int32_t length;
+};
+
+
+// Reads are ranked by score (best first), with ties going to the read which came first in the input.
+inline bool better_read(const ScoredRead & a, const ScoredRead & b) {
+    if (a.score != b.score)
+        return a.score > b.score;
+    return a.index < b.index;
+}
+
+
+ScoredRead make_scored_read(double score, size_t index, int length);
+
+size_t select_best_reads(std::vector<ScoredRead> & reads, long long target_bases, long long & kept_bases);
+
+uint64_t score_key(double score);
+
+void sort_best_first(std::vector<ScoredRead> & reads, int threads);
+
+
+// With at least this many reads, main uses a HistogramSelector rather than packing every read for select_best_reads.
+#define HISTOGRAM_SELECTION_MIN_READS 1000000
+
+
+// Finds the cut-off for a base target using histograms of the scores weighted by bases, so its memory use doesn't
+// grow with the number of reads. The caller passes over its reads in index order, giving each one to add and then
+// calling finish_pass, until done is true. The first pass bins reads by the magnitude of their score and each later
+// pass splits the bin holding the cut-off more finely. Once few enough reads are left in that bin (or they all have
+// the same score) one more pass settles it exactly. The kept reads are the same as those chosen by select_best_reads.
+class HistogramSelector
+{
+public:
+    HistogramSelector(long long target_bases);
+
+    bool done() {return m_stage == DONE;}
+    void add(double score, uint32_t index, int length);
+    void finish_pass();
+
+    bool keep(double score, uint32_t index);
+    long long kept_bases() {return m_kept_bases;}
+
+private:
+    enum Stage {HISTOGRAM, COLLECT, TIES, DONE};
+
+    Stage m_stage;
+    bool m_first_pass;
+    long long m_remaining;      // bases still needed from reads with keys in [m_low, m_high]
+    long long m_kept_bases;     // bases of reads already known to be kept
+    uint64_t m_low;
+    uint64_t m_high;
+    uint32_t m_range_count;     // how many reads are in [m_low, m_high]
+
+    // Bins split either the scores' values evenly (m_value_bins) or their keys (bin = (key - m_low) >> m_shift).
+    bool m_value_bins;
+    double m_low_value;
+    double m_bin_scale;
+    int m_shift;
+    std::vector<long long> m_bin_bases;
+    std::vector<uint32_t> m_bin_counts;
+    std::vector<uint64_t> m_bin_low;
+    std::vector<uint64_t> m_bin_high;
+
+    std::vector<ScoredRead> m_collected;
+
+    // Once done, reads are kept if they rank at or above the cut (unless all or none are kept).
+    bool m_keep_all;
+    bool m_has_cut;
+    uint64_t m_cut_key;
+    uint32_t m_cut_index;
+
+    void set_up_bins(bool value_bins);
+};
+
+
+#endif // SELECTION_H
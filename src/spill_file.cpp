@@ -0,0 +1,184 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include "spill_file.h"
+#include "read_record.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+
+// How many reads are read back from a run file at once during the merge.
+#define RUN_BUFFER_READS 4096
+
+
+// Creates a file with a unique name in the directory and unlinks it right away, so only the open handle refers to it.
+// Returns NULL if the file couldn't be made.
+FILE * open_temp_file(const std::string & directory) {
+    std::string path = directory + "/filtlong_XXXXXX";
+    std::vector<char> path_chars(path.begin(), path.end());
+    path_chars.push_back('\0');
+    int fd = mkstemp(path_chars.data());
+    if (fd < 0)
+        return NULL;
+    unlink(path_chars.data());
+    FILE * file = fdopen(fd, "w+b");
+    if (file == NULL) {
+        close(fd);
+        return NULL;
+    }
+    return file;
+}
+
+
+SpillFile::SpillFile(const std::string & directory) : m_ok(true) {
+    m_file = open_temp_file(directory);
+    if (m_file != NULL)
+        setvbuf(m_file, NULL, _IOFBF, 1 << 18);
+}
+
+
+SpillFile::~SpillFile() {
+    if (m_file != NULL)
+        fclose(m_file);
+}
+
+
+void SpillFile::write(Read * read) {
+    CacheWriter writer(m_file);
+    save_read(writer, read);
+    m_ok = m_ok && writer.ok();
+}
+
+
+// Goes back to the first read, ready to read them all again. The first call also finishes the writing, so this is
+// where a full disk shows up.
+bool SpillFile::rewind() {
+    m_ok = m_ok && fflush(m_file) == 0 && fseek(m_file, 0, SEEK_SET) == 0;
+    return m_ok;
+}
+
+
+Read * SpillFile::read(Arguments * args) {
+    if (!m_ok)
+        return NULL;
+    int c = fgetc(m_file);
+    if (c == EOF)
+        return NULL;
+    ungetc(c, m_file);
+    CacheReader reader(m_file);
+    Read * read = load_read(reader, args);
+    m_ok = (read != NULL);
+    return read;
+}
+
+
+ScoreRuns::ScoreRuns(const std::string & directory, size_t run_size, int threads) :
+    m_directory(directory), m_run_size(std::max(size_t(RUN_BUFFER_READS), run_size)), m_threads(threads), m_ok(true) {
+}
+
+
+ScoreRuns::~ScoreRuns() {
+    for (auto file : m_files)
+        fclose(file);
+}
+
+
+bool ScoreRuns::add(double score, uint32_t index, int length) {
+    m_run.push_back(make_scored_read(score, index, length));
+    if (m_run.size() >= m_run_size)
+        m_ok = m_ok && write_run();
+    return m_ok;
+}
+
+
+bool ScoreRuns::write_run() {
+    sort_best_first(m_run, m_threads);
+    FILE * file = open_temp_file(m_directory);
+    if (file == NULL)
+        return false;
+    m_files.push_back(file);
+    bool ok = fwrite(m_run.data(), sizeof(ScoredRead), m_run.size(), file) == m_run.size();
+    m_run.clear();
+    return ok && fflush(file) == 0 && fseek(file, 0, SEEK_SET) == 0;
+}
+
+
+// If every read fit in one run, it's just sorted in memory. Otherwise the last run is written out like the others and
+// the merge starts with the first read of each run.
+bool ScoreRuns::finish() {
+    if (m_ok && m_files.empty()) {
+        sort_best_first(m_run, m_threads);
+        m_positions.push_back(0);
+        return true;
+    }
+    if (m_ok && !m_run.empty())
+        m_ok = write_run();
+    std::vector<ScoredRead>().swap(m_run);
+    m_buffers.resize(m_files.size());
+    m_positions.resize(m_files.size());
+    for (size_t run = 0; run < m_files.size() && m_ok; ++run) {
+        if (fill_buffer(run))
+            m_heap.push_back(run);
+    }
+    auto after = [this](size_t a, size_t b) {return run_after(a, b);};
+    std::make_heap(m_heap.begin(), m_heap.end(), after);
+    return m_ok;
+}
+
+
+// Reads the run's next block of reads into its buffer. Returns false at the end of the run (or on a read error).
+bool ScoreRuns::fill_buffer(size_t run) {
+    m_buffers[run].resize(RUN_BUFFER_READS);
+    size_t count = fread(m_buffers[run].data(), sizeof(ScoredRead), RUN_BUFFER_READS, m_files[run]);
+    if (count < RUN_BUFFER_READS && ferror(m_files[run]))
+        m_ok = false;
+    m_buffers[run].resize(count);
+    m_positions[run] = 0;
+    return count > 0;
+}
+
+
+// Whether run a's next read ranks after run b's, which makes the heap's top the run with the best next read.
+bool ScoreRuns::run_after(size_t a, size_t b) {
+    const ScoredRead & read_a = m_buffers[a][m_positions[a]];
+    const ScoredRead & read_b = m_buffers[b][m_positions[b]];
+    uint64_t key_a = score_key(read_a.score), key_b = score_key(read_b.score);
+    if (key_a != key_b)
+        return key_a < key_b;
+    return read_a.index > read_b.index;
+}
+
+
+bool ScoreRuns::next(ScoredRead & read) {
+    if (m_files.empty()) {
+        if (m_positions[0] >= m_run.size())
+            return false;
+        read = m_run[m_positions[0]++];
+        return true;
+    }
+    if (m_heap.empty() || !m_ok)
+        return false;
+    auto after = [this](size_t a, size_t b) {return run_after(a, b);};
+    std::pop_heap(m_heap.begin(), m_heap.end(), after);
+    size_t run = m_heap.back();
+    read = m_buffers[run][m_positions[run]++];
+    if (m_positions[run] < m_buffers[run].size() || fill_buffer(run))
+        std::push_heap(m_heap.begin(), m_heap.end(), after);
+    else
+        m_heap.pop_back();
+    return m_ok;
+}
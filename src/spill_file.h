@@ -0,0 +1,88 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "arguments.h"
+#include "read.h"
+#include "selection.h"
+
+
+// With --memory_budget, reads aren't kept in memory between passes. Instead, each input's reads are written to a spill
+// file as they are scored (in the score cache's read record format) and read back one at a time when they're needed.
+// Spill files are unlinked as soon as they are created, so they disappear when Filtlong exits, however it exits.
+
+FILE * open_temp_file(const std::string & directory);
+
+
+class SpillFile
+{
+public:
+    SpillFile(const std::string & directory);
+    ~SpillFile();
+
+    bool is_open() {return m_file != NULL;}
+    void write(Read * read);
+    bool rewind();
+    Read * read(Arguments * args);    // the next read (owned by the caller), or NULL at the end
+    bool ok() {return m_ok;}
+
+private:
+    FILE * m_file;
+    bool m_ok;
+};
+
+
+// Finds target cut-offs for reads which don't all fit in memory at once. Passed reads are given to add in any order,
+// which gathers them into runs of up to run_size reads. Each full run is sorted best first and written to a temporary
+// file. After finish, next gives every read in best-first order (the same ranking as sort_best_first), from a k-way
+// merge of the runs. Only one run plus a small buffer per run is in memory at any time.
+class ScoreRuns
+{
+public:
+    ScoreRuns(const std::string & directory, size_t run_size, int threads);
+    ~ScoreRuns();
+
+    bool add(double score, uint32_t index, int length);
+    bool finish();
+    bool next(ScoredRead & read);
+    bool ok() {return m_ok;}
+
+private:
+    std::string m_directory;
+    size_t m_run_size;
+    int m_threads;
+    std::vector<ScoredRead> m_run;
+    bool m_ok;
+
+    // Each run's file and the part of it which has been read back, plus a heap of the runs by their next read.
+    std::vector<FILE *> m_files;
+    std::vector<std::vector<ScoredRead> > m_buffers;
+    std::vector<size_t> m_positions;
+    std::vector<size_t> m_heap;
+
+    bool write_run();
+    bool fill_buffer(size_t run);
+    bool run_after(size_t a, size_t b);
+};
+
+
+#endif // SPILL_FILE_H
@@ -0,0 +1,201 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#include "task_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "misc.h"
+
+
+// Which worker the current thread is (-1 for threads outside the pool), and how long the task it's running has spent
+// running other tasks or blocked waiting, which doesn't count towards that task's stage.
+static thread_local int t_worker = -1;
+static thread_local long long t_nested = 0;
+
+static std::unique_ptr<TaskPool> shared_pool;
+
+
+TaskPool::TaskPool(int threads) :
+    m_queued(0), m_stopping(false), m_start(std::chrono::steady_clock::now()) {
+    for (auto & use : m_use) {
+        use.tasks = 0;
+        use.busy = 0;
+        use.first_start = -1;
+        use.last_end = 0;
+    }
+    int workers = std::max(threads, 1) - 1;
+    for (int i = 0; i <= workers; ++i)
+        m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+    for (int i = 0; i < workers; ++i)
+        m_workers.push_back(std::thread(&TaskPool::work, this, i));
+}
+
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto & worker : m_workers)
+        worker.join();
+}
+
+
+void TaskPool::submit(TaskGroup & group, TaskStage stage, std::function<void()> function) {
+    ++group.m_pending;
+    Task task = {std::move(function), &group, stage};
+    if (m_workers.empty()) {
+        run_task(task);
+        return;
+    }
+    Queue & queue = *m_queues[t_worker >= 0 ? size_t(t_worker) : m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    ++m_queued;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_condition.notify_one();
+}
+
+
+void TaskPool::wait(TaskGroup & group) {
+    while (!group.done()) {
+        Task task;
+        if (take(task)) {
+            run_task(task);
+            continue;
+        }
+        long long start = now();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&]() {return group.done() || m_queued.load() > 0;});
+        }
+        t_nested += now() - start;
+    }
+}
+
+
+void TaskPool::work(int worker) {
+    t_worker = worker;
+    while (true) {
+        Task task;
+        if (take(task)) {
+            run_task(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() {return m_stopping || m_queued.load() > 0;});
+        if (m_stopping && m_queued.load() <= 0)
+            return;
+    }
+}
+
+
+// Takes the newest task from the thread's own deque, or else the oldest from another.
+bool TaskPool::take(Task & task) {
+    if (m_queued.load() <= 0)
+        return false;
+    size_t count = m_queues.size();
+    size_t own = (t_worker >= 0) ? size_t(t_worker) : count - 1;
+    for (size_t i = 0; i < count; ++i) {
+        Queue & queue = *m_queues[(own + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+
+void TaskPool::run_task(Task & task) {
+    long long outer_nested = t_nested;
+    t_nested = 0;
+    long long start = now();
+    task.function();
+    long long end = now();
+
+    StageUse & use = m_use[task.stage];
+    ++use.tasks;
+    use.busy += (end - start) - t_nested;
+    long long first = use.first_start.load();
+    while ((first < 0 || start < first) && !use.first_start.compare_exchange_weak(first, start));
+    long long last = use.last_end.load();
+    while (end > last && !use.last_end.compare_exchange_weak(last, end));
+    t_nested = outer_nested + (end - start);
+
+    if (--task.group->m_pending == 0) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_condition.notify_all();
+    }
+}
+
+
+long long TaskPool::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+
+// For each stage which ran tasks: its busy time (summed over threads), the time from its first task starting to its
+// last finishing, and how much of the pool it used over that time.
+void TaskPool::print_utilisation() {
+    static const char * stage_names[TASK_STAGE_COUNT] = {"reference hashing", "scoring", "decompression",
+                                                         "compression", "sorting"};
+    std::cerr << "Thread use (" << threads() << " threads)\n";
+    for (int stage = 0; stage < TASK_STAGE_COUNT; ++stage) {
+        StageUse & use = m_use[stage];
+        if (use.tasks == 0)
+            continue;
+        double busy = use.busy / 1.0e9;
+        double span = (use.last_end - use.first_start) / 1.0e9;
+        double utilisation = (span > 0.0) ? 100.0 * busy / (span * threads()) : 0.0;
+        std::string busy_text, span_text, utilisation_text;
+        append_fixed(busy_text, busy, 2);
+        append_fixed(span_text, span, 2);
+        append_fixed(utilisation_text, std::min(utilisation, 100.0), 0);
+        std::cerr << "  " << stage_names[stage] << ": " << int_to_string(use.tasks) << " tasks, " << busy_text
+                  << " s busy over " << span_text << " s (" << utilisation_text << "% of the threads)\n";
+    }
+    std::cerr << "\n";
+}
+
+
+void start_task_pool(int threads) {
+    shared_pool.reset(new TaskPool(threads));
+}
+
+
+TaskPool & task_pool() {
+    if (!shared_pool)
+        shared_pool.reset(new TaskPool(1));
+    return *shared_pool;
+}
@@ -0,0 +1,117 @@
+// Copyright 2017 Ryan Wick
+
+// This file is part of Filtlong
+
+// Filtlong is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later
+// version.
+
+// Filtlong is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+// warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+// details.
+
+// You should have received a copy of the GNU General Public License along with Filtlong.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// The stages which submit tasks, for the utilisation report.
+enum TaskStage {REFERENCE_HASHING, SCORING, DECOMPRESSION, COMPRESSION, SORTING, TASK_STAGE_COUNT};
+
+
+// A set of submitted tasks which can be waited on together.
+class TaskGroup
+{
+public:
+    TaskGroup() : m_pending(0) {}
+    bool done() const {return m_pending.load() == 0;}
+
+private:
+    friend class TaskPool;
+    std::atomic<int> m_pending;
+};
+
+
+// A work-stealing task scheduler. There are threads - 1 workers, each with its own deque of tasks: a worker runs the
+// newest task from its own deque, or else steals the oldest from another deque. Tasks submitted by a worker go on its
+// own deque, and tasks from any other thread go on a shared one. A thread waiting for a group runs tasks until the
+// group is done, so tasks can submit and wait for tasks of their own, and the waiting thread makes up the last of the
+// threads. With one thread there are no workers, and tasks just run as they're submitted.
+class TaskPool
+{
+public:
+    explicit TaskPool(int threads);
+    ~TaskPool();
+
+    int threads() const {return int(m_workers.size()) + 1;}
+
+    void submit(TaskGroup & group, TaskStage stage, std::function<void()> task);
+    void wait(TaskGroup & group);
+
+    // Runs function(0) to function(count - 1) as tasks and waits for them all.
+    template <typename Function>
+    void run(TaskStage stage, size_t count, Function function) {
+        TaskGroup group;
+        for (size_t i = 0; i < count; ++i)
+            submit(group, stage, [&function, i]() {function(i);});
+        wait(group);
+    }
+
+    void print_utilisation();
+
+private:
+    struct Task
+    {
+        std::function<void()> function;
+        TaskGroup * group;
+        TaskStage stage;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    struct StageUse
+    {
+        std::atomic<long long> tasks;
+        std::atomic<long long> busy;         // nanoseconds spent running tasks, not counting tasks run within them
+        std::atomic<long long> first_start;  // nanoseconds since the pool started
+        std::atomic<long long> last_end;
+    };
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<Queue>> m_queues;    // one per worker, then the shared one
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<int> m_queued;
+    bool m_stopping;
+    StageUse m_use[TASK_STAGE_COUNT];
+    std::chrono::steady_clock::time_point m_start;
+
+    void work(int worker);
+    bool take(Task & task);
+    void run_task(Task & task);
+    long long now();
+};
+
+
+// Every parallel stage submits its work to this one pool, so between them they use --threads threads. main starts it
+// with the thread count before any work is done (until then, it has one thread).
+void start_task_pool(int threads);
+TaskPool & task_pool();
+
+
+#endif // TASK_POOL_H
@@ -0,0 +1,174 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import struct
+import subprocess
+import tempfile
+import zlib
+
+from test.test_sort import load_fastq
+
+
+HEADER_TEXT = '@HD\tVN:1.6\tSO:unknown\n@RG\tID:run1\tSM:test\n'
+BASES = '=ACMGRSVTWYHKDBN'
+
+
+def bgzf_compress(data, block_size=1000):
+    """
+    Small blocks, so the reads span many blocks.
+    """
+    out = b''
+    for i in range(0, len(data), block_size):
+        chunk = data[i:i + block_size]
+        compressor = zlib.compressobj(6, zlib.DEFLATED, -15)
+        compressed = compressor.compress(chunk) + compressor.flush()
+        header = struct.pack('<BBBBIBBHBBHH', 31, 139, 8, 4, 0, 0, 255, 6, 66, 67, 2,
+                             len(compressed) + 25)
+        out += header + compressed + struct.pack('<II', zlib.crc32(chunk), len(chunk))
+    return out + bytes.fromhex('1f8b08040000000000ff0600424302001b0003000000000000000000')
+
+
+def bgzf_decompress(data):
+    out = b''
+    while data:
+        block_size = struct.unpack('<H', data[16:18])[0] + 1
+        out += zlib.decompress(data[18:block_size - 8], -15)
+        data = data[block_size:]
+    return out
+
+
+def make_ubam(reads, filename):
+    data = b'BAM\1' + struct.pack('<i', len(HEADER_TEXT)) + HEADER_TEXT.encode() + struct.pack('<i', 0)
+    for name, seq, qual in reads:
+        packed = bytearray()
+        for i in range(0, len(seq), 2):
+            high = BASES.index(chr(seq[i]))
+            low = BASES.index(chr(seq[i + 1])) if i + 1 < len(seq) else 0
+            packed.append(high << 4 | low)
+        tags = b'RGZrun1\0' + b'MMZC+m?,0;\0' + b'qsi' + struct.pack('<i', 17)
+        record = struct.pack('<iiBBHHHiiii', -1, -1, len(name) + 1, 255, 4680, 0, 4, len(seq), -1, -1, 0)
+        record += name + b'\0' + bytes(packed) + bytes(q - 33 for q in qual) + tags
+        data += struct.pack('<i', len(record)) + record
+    with open(filename, 'wb') as f:
+        f.write(bgzf_compress(data))
+
+
+def load_bam(filename):
+    """
+    Returns the header text and a list of (name, sequence, qualities, tags) for each record.
+    """
+    with open(filename, 'rb') as f:
+        data = bgzf_decompress(f.read())
+    assert data[:4] == b'BAM\1'
+    text_length = struct.unpack('<i', data[4:8])[0]
+    header_text = data[8:8 + text_length].decode()
+    pos = 8 + text_length + 4
+    records = []
+    while pos < len(data):
+        block_size = struct.unpack('<i', data[pos:pos + 4])[0]
+        record = data[pos + 4:pos + 4 + block_size]
+        pos += 4 + block_size
+        name_length, cigar_count, seq_length = record[8], struct.unpack('<H', record[12:14])[0], \
+            struct.unpack('<i', record[16:20])[0]
+        p = 32
+        name = record[p:p + name_length - 1]
+        p += name_length + 4 * cigar_count
+        packed = record[p:p + (seq_length + 1) // 2]
+        p += (seq_length + 1) // 2
+        seq = ''.join(BASES[(packed[i // 2] >> 4) if i % 2 == 0 else (packed[i // 2] & 15)]
+                      for i in range(seq_length)).encode()
+        qual = bytes(q + 33 for q in record[p:p + seq_length])
+        tags = record[p + seq_length:]
+        records.append((name, seq, qual, tags))
+    return header_text, records
+
+
+class TestBam(unittest.TestCase):
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.fastq_reads = load_fastq(os.path.join(os.path.dirname(__file__), 'test_sort.fastq'))
+        self.bam_input = os.path.join(self.temp_dir, 'reads.bam')
+        make_ubam(self.fastq_reads, self.bam_input)
+        self.split_fastq_reads = load_fastq(os.path.join(os.path.dirname(__file__), 'test_split.fastq'))
+        self.split_bam_input = os.path.join(self.temp_dir, 'split.bam')
+        make_ubam(self.split_fastq_reads, self.split_bam_input)
+        self.output = os.path.join(self.temp_dir, 'out.bam')
+
+    def tearDown(self):
+        for f in os.listdir(self.temp_dir):
+            os.remove(os.path.join(self.temp_dir, f))
+        os.rmdir(self.temp_dir)
+
+    def run_command(self, command):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        assembly_reference = os.path.join(os.path.dirname(__file__), 'test_reference.fasta')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('SPLIT_BAM', self.split_bam_input)
+        command = command.replace('BAM', self.bam_input)
+        command = command.replace('ASSEMBLY', assembly_reference)
+        command = command.replace('OUTPUT', self.output)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        _, err = p.communicate()
+        return err.decode(), p.returncode
+
+    def test_bam_target_bases(self):
+        """
+        This matches test_sort_medium_threshold_1 in test_sort.py.
+        """
+        console_out, return_code = self.run_command('filtlong --target_bases 10000 BAM > OUTPUT')
+        self.assertEqual(return_code, 0)
+        header_text, records = load_bam(self.output)
+        self.assertEqual([x[0].decode() for x in records], ['test_sort_2', 'test_sort_3'])
+        self.assertTrue('keeping 10,000 bp' in console_out)
+        self.assertEqual(header_text, HEADER_TEXT)
+
+    def test_bam_records_unchanged(self):
+        console_out, return_code = self.run_command('filtlong --min_length 1 --threads 4 BAM > OUTPUT')
+        self.assertEqual(return_code, 0)
+        _, records = load_bam(self.output)
+        self.assertEqual([(x[0], x[1], x[2]) for x in records], self.fastq_reads)
+        for record in records:
+            self.assertTrue(b'RGZrun1\0' in record[3])
+            self.assertTrue(b'MMZ' in record[3])
+
+    def test_bam_with_reference(self):
+        console_out, return_code = self.run_command('filtlong -a ASSEMBLY --target_bases 10000 BAM > OUTPUT')
+        self.assertEqual(return_code, 0)
+        _, records = load_bam(self.output)
+        self.assertEqual([x[0].decode() for x in records], ['test_sort_1', 'test_sort_3'])
+
+    def test_bam_split(self):
+        """
+        Child reads keep the parent's tags, except for base modifications.
+        """
+        console_out, return_code = self.run_command('filtlong -a ASSEMBLY --split 100 SPLIT_BAM > OUTPUT')
+        self.assertEqual(return_code, 0)
+        _, records = load_bam(self.output)
+        self.assertTrue(len(records) > len(self.split_fastq_reads))
+        parents = {x[0]: x for x in self.split_fastq_reads}
+        for name, seq, qual, tags in records:
+            if name in parents:    # reads without bad ranges aren't split
+                continue
+            parent_name, child_range = name.rsplit(b'_', 1)
+            _, parent_seq, parent_qual = parents[parent_name]
+            start, end = [int(x) for x in child_range.decode().split('-')]
+            self.assertEqual(seq, parent_seq[start - 1:end])
+            self.assertEqual(qual, parent_qual[start - 1:end])
+            self.assertTrue(b'RGZrun1\0' in tags)
+            self.assertFalse(b'MMZ' in tags)
@@ -0,0 +1,94 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import gzip
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+
+class TestCompressedOutput(unittest.TestCase):
+    """
+    An --output file ending in .gz is written as BGZF, which any gzip reader can decompress to
+    the same reads as the uncompressed output.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('MANY', os.path.join(self.temp_dir, 'many.fastq'))
+        command = command.replace('OUTPUT', os.path.join(self.temp_dir, 'out'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out, err.decode(), p.returncode
+
+    def read_gzip(self, filename):
+        with gzip.open(os.path.join(self.temp_dir, filename), 'rb') as f:
+            return f.read()
+
+    def test_gzip_output(self):
+        expected, _, return_code = self.run_command('filtlong --target_bases 10000 INPUT')
+        self.assertEqual(return_code, 0)
+        _, _, return_code = self.run_command('filtlong --target_bases 10000 -o OUTPUT.fastq.gz INPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.read_gzip('out.fastq.gz'), expected)
+
+    def test_gzip_output_threads(self):
+        """
+        Enough output for many BGZF blocks, so each thread compresses several. The compressed file
+        doesn't depend on the thread count.
+        """
+        random.seed(0)
+        with open(os.path.join(self.temp_dir, 'many.fastq'), 'wt') as f:
+            for i in range(2000):
+                length = random.randint(500, 1500)
+                seq = ''.join(random.choice('ACGT') for _ in range(length))
+                qual = ''.join(chr(random.randint(38, 73)) for _ in range(length))
+                f.write('@read_' + str(i) + '\n' + seq + '\n+\n' + qual + '\n')
+        expected, _, _ = self.run_command('filtlong --keep_percent 80 MANY')
+        compressed = []
+        for threads in [1, 3]:
+            _, _, return_code = self.run_command('filtlong --keep_percent 80 --threads ' + str(threads) +
+                                                 ' -o OUTPUT_' + str(threads) + '.fastq.gz MANY')
+            self.assertEqual(return_code, 0)
+            self.assertEqual(self.read_gzip('out_' + str(threads) + '.fastq.gz'), expected)
+            with open(os.path.join(self.temp_dir, 'out_' + str(threads) + '.fastq.gz'), 'rb') as f:
+                compressed.append(f.read())
+        self.assertEqual(compressed[0], compressed[1])
+
+    def test_compression_level(self):
+        expected, _, _ = self.run_command('filtlong --target_bases 10000 INPUT')
+        for level in [0, 9]:
+            _, _, return_code = self.run_command('filtlong --target_bases 10000 --compression_level ' +
+                                                 str(level) + ' -o OUTPUT.fastq.gz INPUT')
+            self.assertEqual(return_code, 0)
+            self.assertEqual(self.read_gzip('out.fastq.gz'), expected)
+
+    def test_bad_compression_level(self):
+        _, err, return_code = self.run_command('filtlong --target_bases 10000 --compression_level 10 INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--compression_level' in err)
@@ -0,0 +1,108 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import re
+import shutil
+import subprocess
+import tempfile
+
+
+def load_fastq(fastq_text):
+    lines = fastq_text.strip().split('\n') if fastq_text.strip() else []
+    return [(lines[i][1:].split(' ')[0], lines[i + 1], lines[i + 3]) for i in range(0, len(lines), 4)]
+
+
+class TestFailedOutput(unittest.TestCase):
+    """
+    Between them, the output and --failed_output should hold every base of the input exactly once.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.failed = os.path.join(self.temp_dir, 'failed.fastq')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(test_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', os.path.join(test_dir, 'test_reference.fasta'))
+        command = command.replace('FAILED', self.failed)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def check_partition(self, input_filename, command):
+        out, _, return_code = self.run_command(command)
+        self.assertEqual(return_code, 0)
+        with open(self.failed, 'rt') as f:
+            failed = load_fastq(f.read())
+        with open(os.path.join(os.path.dirname(__file__), input_filename), 'rt') as f:
+            reads = {name: (seq, qual) for name, seq, qual in load_fastq(f.read())}
+        pieces = {name: [] for name in reads}
+        for name, seq, qual in load_fastq(out) + failed:
+            if name in reads:
+                start, end = 0, len(reads[name][0])
+            else:
+                name, start, end = re.match(r'(.+)_(\d+)-(\d+)$', name).groups()
+                start, end = int(start) - 1, int(end)
+            self.assertEqual(reads[name][0][start:end], seq)
+            self.assertEqual(reads[name][1][start:end], qual)
+            pieces[name].append((start, end))
+        for name, ranges in pieces.items():
+            position = 0
+            for start, end in sorted(ranges):
+                self.assertEqual(start, position)
+                position = end
+            self.assertEqual(position, len(reads[name][0]))
+        return load_fastq(out), failed
+
+    def test_target(self):
+        kept, failed = self.check_partition('test_sort.fastq',
+                                            'filtlong --target_bases 10000 --failed_output FAILED INPUT')
+        self.assertTrue(len(kept) > 0)
+        self.assertTrue(len(failed) > 0)
+
+    def test_nothing_failed(self):
+        kept, failed = self.check_partition('test_sort.fastq',
+                                            'filtlong --min_length 1 --failed_output FAILED INPUT')
+        self.assertEqual(failed, [])
+
+    def test_split(self):
+        kept, failed = self.check_partition('test_split.fastq',
+                                            'filtlong -a ASSEMBLY --trim --split 100 --min_length 1 '
+                                            '--failed_output FAILED SPLIT')
+        self.assertTrue(any(re.search(r'_\d+-\d+$', name) for name, _, _ in failed))
+
+    def test_split_target(self):
+        self.check_partition('test_split.fastq',
+                             'filtlong -a ASSEMBLY --split 100 --target_bases 5000 --failed_output FAILED SPLIT')
+
+    def test_streaming(self):
+        self.check_partition('test_sort.fastq',
+                             'filtlong --streaming --warm_up 5 --keep_percent 50 --failed_output FAILED INPUT')
+
+    def test_bad_file(self):
+        _, err, return_code = self.run_command('filtlong --min_length 1 --failed_output /nonexistent/failed.fq '
+                                               'INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('could not open output file' in err)
@@ -0,0 +1,78 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import gzip
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+from test.test_bam import make_ubam
+
+
+class TestIoUring(unittest.TestCase):
+    """
+    --io_uring only changes how input files are read, so the output should be the same with or
+    without it (whether or not io_uring is available on the machine running the tests).
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        test_dir = os.path.dirname(__file__)
+        with open(os.path.join(test_dir, 'test_split.fastq'), 'rb') as f:
+            split_fastq = f.read()
+        with gzip.open(os.path.join(self.temp_dir, 'split.fastq.gz'), 'wb') as f:
+            f.write(split_fastq)
+
+        # Enough reads to span many of the reader's chunks.
+        reads = load_fastq(os.path.join(test_dir, 'test_split.fastq'))
+        with open(os.path.join(self.temp_dir, 'many.fastq'), 'wb') as f:
+            for i in range(200):
+                for name, seq, qual in reads:
+                    f.write(b'@' + name + b'_' + str(i).encode() + b'\n' + seq + b'\n+\n' + qual + b'\n')
+        make_ubam([(name + b'_' + str(i).encode(), seq, qual) for i in range(50) for name, seq, qual in reads],
+                  os.path.join(self.temp_dir, 'many.bam'))
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        assembly_reference = os.path.join(os.path.dirname(__file__), 'test_reference.fasta')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('ASSEMBLY', assembly_reference)
+        command = command.replace('TEMP', self.temp_dir)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, _ = p.communicate()
+        self.assertEqual(p.returncode, 0)
+        return out
+
+    def check_same_output(self, command):
+        pread_output = self.run_command(command)
+        io_uring_output = self.run_command(command.replace('filtlong', 'filtlong --io_uring'))
+        self.assertTrue(len(pread_output) > 0)
+        self.assertEqual(pread_output, io_uring_output)
+
+    def test_io_uring_fastq(self):
+        self.check_same_output('filtlong --keep_percent 50 TEMP/many.fastq')
+
+    def test_io_uring_gzipped(self):
+        self.check_same_output('filtlong -a ASSEMBLY --split 100 TEMP/split.fastq.gz')
+
+    def test_io_uring_bam(self):
+        self.check_same_output('filtlong --keep_percent 20 TEMP/many.bam')
@@ -0,0 +1,126 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+
+def reverse_complement(seq):
+    return seq[::-1].translate(str.maketrans('ACGT', 'TGCA'))
+
+
+class TestLongReads(unittest.TestCase):
+    """
+    With a reference, reads longer than 250 kbp are scored in chunks. These tests use reads of a
+    few chunks, with reference matches which cross the chunk boundaries, and check their qualities
+    against ones worked out here from the whole read.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        random.seed(0)
+        reference = ''.join(random.choice('ACGT') for _ in range(100000))
+        self.reference_kmers = set()
+        for seq in [reference, reverse_complement(reference)]:
+            self.reference_kmers.update(seq[i:i + 16] for i in range(len(seq) - 15))
+        with open(os.path.join(self.temp_dir, 'reference.fasta'), 'wt') as f:
+            f.write('>reference\n' + reference + '\n')
+
+        # Chunk boundaries fall at multiples of a third of each read's length, so the reads are built from reference
+        # pieces and random bases placed to just cross them.
+        self.reads = []
+        for length in [600000, 750003]:
+            seq = ''
+            boundaries = [length * i // 3 for i in range(1, 3)]
+            while len(seq) < length:
+                near = [b for b in boundaries if 0 < b - len(seq) <= 3000]
+                if near:
+                    seq += ''.join(random.choice('ACGT') for _ in range(near[0] - len(seq) - random.randint(1, 14)))
+                    start = random.randint(0, len(reference) - 100)
+                    seq += reference[start:start + 100]
+                elif random.random() < 0.6:
+                    start = random.randint(0, len(reference) - 5000)
+                    piece = reference[start:start + random.randint(20, 5000)]
+                    seq += piece if random.random() < 0.5 else reverse_complement(piece)
+                else:
+                    seq += ''.join(random.choice('ACGT') for _ in range(random.randint(1, 2500)))
+            self.reads.append(seq[:length])
+        with open(os.path.join(self.temp_dir, 'reads.fastq'), 'wt') as f:
+            for i, seq in enumerate(self.reads):
+                f.write('@read_' + str(i) + '\n' + seq + '\n+\n' + 'I' * len(seq) + '\n')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('REFERENCE', os.path.join(self.temp_dir, 'reference.fasta'))
+        command = command.replace('READS', os.path.join(self.temp_dir, 'reads.fastq'))
+        command = command.replace('TABLE', os.path.join(self.temp_dir, 'scores.tsv'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def covered_bases(self, seq):
+        covered = [0] * len(seq)
+        for i in range(len(seq) - 15):
+            if seq[i:i + 16] in self.reference_kmers:
+                for j in range(i, i + 16):
+                    covered[j] = 1
+        return covered
+
+    def test_qualities(self):
+        window_size = 1000
+        _, _, return_code = self.run_command('filtlong -a REFERENCE --min_length 1 --window_size ' + str(window_size) +
+                                             ' --scores_out TABLE READS')
+        self.assertEqual(return_code, 0)
+        with open(os.path.join(self.temp_dir, 'scores.tsv'), 'rt') as f:
+            lines = f.read().strip().split('\n')
+        header = lines[0].split('\t')
+        rows = [dict(zip(header, line.split('\t'))) for line in lines[1:]]
+        self.assertEqual(len(rows), 2)
+        for row, seq in zip(rows, self.reads):
+            covered = self.covered_bases(seq)
+            window_count = sum(covered[:window_size])
+            min_window_count = window_count
+            for i in range(window_size, len(covered)):
+                window_count += covered[i] - covered[i - window_size]
+                min_window_count = min(min_window_count, window_count)
+            self.assertAlmostEqual(float(row['mean_quality']), 100.0 * sum(covered) / len(seq), delta=0.00006)
+            self.assertAlmostEqual(float(row['window_quality']), 100.0 * min_window_count / window_size,
+                                   delta=0.00006)
+
+    def test_trim(self):
+        out, _, return_code = self.run_command('filtlong -a REFERENCE --min_length 1 --trim READS')
+        self.assertEqual(return_code, 0)
+        lines = out.strip().split('\n')
+        for i, seq in enumerate(self.reads):
+            covered = self.covered_bases(seq)
+            first, last = covered.index(1), len(covered) - covered[::-1].index(1)
+            self.assertEqual(lines[i * 4 + 1], seq[first:last])
+
+    def test_threads(self):
+        command = 'filtlong -a REFERENCE --split 20 --min_length 1 READS'
+        expected, _, _ = self.run_command(command)
+        out, _, return_code = self.run_command(command + ' --threads 3')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(out, expected)
@@ -0,0 +1,103 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+
+class TestMemoryBudget(unittest.TestCase):
+    """
+    With --memory_budget, scores are spilled to temporary files, but the output should be exactly
+    the same as without it.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.spill_dir = os.path.join(self.temp_dir, 'spill')
+        os.mkdir(self.spill_dir)
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(test_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', os.path.join(test_dir, 'test_reference.fasta'))
+        command = command.replace('MANY', os.path.join(self.temp_dir, 'many.fastq'))
+        command = command.replace('SPILL', self.spill_dir)
+        command = command.replace('OUTPUT', os.path.join(self.temp_dir, 'out'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out, err.decode(), p.returncode
+
+    def check_same_output(self, command):
+        normal_out, _, normal_return_code = self.run_command(command)
+        budget_command = command.replace('filtlong', 'filtlong --memory_budget 1m --temp_dir SPILL', 1)
+        budget_out, _, budget_return_code = self.run_command(budget_command)
+        self.assertEqual(normal_return_code, 0)
+        self.assertEqual(budget_return_code, 0)
+        self.assertEqual(budget_out, normal_out)
+        self.assertEqual(os.listdir(self.spill_dir), [])
+        return budget_out
+
+    def test_same_output(self):
+        for options in ['--target_bases 10000', '--keep_percent 50', '--min_length 5000',
+                        '--min_mean_q 80 --length_weight 0.5 --target_bases 12000']:
+            self.check_same_output('filtlong ' + options + ' INPUT')
+
+    def test_same_output_split(self):
+        output = self.check_same_output('filtlong -a ASSEMBLY --split 100 --target_bases 5000 SPLIT')
+        self.assertTrue(len(output) > 0)
+
+    def test_same_output_many_runs(self):
+        """
+        Enough reads that the ranking is spread over several sorted runs, with plenty of tied
+        scores across them.
+        """
+        random.seed(0)
+        with open(os.path.join(self.temp_dir, 'many.fastq'), 'wt') as f:
+            for i in range(50000):
+                length = random.choice([100, 200, 300])
+                f.write('@read_' + str(i) + '\n' + 'A' * length + '\n+\n' +
+                        random.choice('+5?I') * length + '\n')
+        for options in ['--target_bases 1000000', '--keep_percent 90',
+                        '--target_bases 100k,2m,5m -o OUTPUT_1,OUTPUT_2,OUTPUT_3']:
+            self.check_same_output('filtlong ' + options + ' MANY')
+        budget_outputs = [open(os.path.join(self.temp_dir, 'out_' + str(i)), 'rb').read() for i in [1, 2, 3]]
+        self.run_command('filtlong --target_bases 100k,2m,5m -o OUTPUT_1,OUTPUT_2,OUTPUT_3 MANY')
+        for i in [1, 2, 3]:
+            self.assertEqual(open(os.path.join(self.temp_dir, 'out_' + str(i)), 'rb').read(),
+                             budget_outputs[i - 1])
+
+    def test_incompatible_options(self):
+        for options in ['--verbose', '--streaming', '--score_cache OUTPUT']:
+            _, console_out, return_code = self.run_command('filtlong --memory_budget 1m ' + options +
+                                                           ' --target_bases 10000 INPUT')
+            self.assertEqual(return_code, 1)
+            self.assertTrue('cannot be used with' in console_out)
+
+    def test_bad_temp_dir(self):
+        _, console_out, return_code = self.run_command('filtlong --memory_budget 1m --temp_dir '
+                                                       'SPILL/missing --min_length 1 INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('could not create a temporary file' in console_out)
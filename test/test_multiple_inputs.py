@@ -0,0 +1,122 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import gzip
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+
+
+class TestMultipleInputs(unittest.TestCase):
+    """
+    These tests split test_sort.fastq into one file per read, so the results can be compared to
+    running on the single file.
+    """
+
+    def setUp(self):
+        self.input_dir = tempfile.mkdtemp()
+        test_sort = os.path.join(os.path.dirname(__file__), 'test_sort.fastq')
+        with open(test_sort, 'rt') as fastq:
+            lines = [x for x in fastq.read().splitlines() if x]
+        self.split_files = []
+        for i in range(len(lines) // 4):
+            filename = os.path.join(self.input_dir, 'reads_' + str(i + 1) + '.fastq')
+            if i == 1:
+                filename += '.gz'
+                with gzip.open(filename, 'wt') as f:
+                    f.write('\n'.join(lines[i * 4:i * 4 + 4]) + '\n')
+            else:
+                with open(filename, 'wt') as f:
+                    f.write('\n'.join(lines[i * 4:i * 4 + 4]) + '\n')
+            self.split_files.append(filename)
+        with open(os.path.join(self.input_dir, 'notes.txt'), 'wt') as f:
+            f.write('not a read file\n')
+
+    def tearDown(self):
+        shutil.rmtree(self.input_dir)
+
+    def run_command(self, command):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        input_path = os.path.join(os.path.dirname(__file__), 'test_sort.fastq')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', input_path)
+        command = command.replace('SPLIT_FILES', ' '.join(self.split_files))
+        command = command.replace('SPLIT_DIR', self.input_dir)
+        command = command.replace('OUTPUT', os.path.join(self.input_dir, 'out.fastq'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        _, err = p.communicate()
+        return err.decode(), p.returncode
+
+    def output_read_names(self):
+        output_reads = load_fastq(os.path.join(self.input_dir, 'out.fastq'))
+        return [x[0].decode() for x in output_reads]
+
+    def test_multiple_files(self):
+        console_out, return_code = self.run_command('filtlong --target_bases 10000 SPLIT_FILES > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.output_read_names(), ['test_sort_2', 'test_sort_3'])
+        self.assertTrue('keeping 10,000 bp' in console_out)
+
+    def test_multiple_files_threads(self):
+        console_out, return_code = self.run_command('filtlong --threads 3 --target_bases 10000 '
+                                                    'SPLIT_FILES > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.output_read_names(), ['test_sort_2', 'test_sort_3'])
+        self.assertTrue('keeping 10,000 bp' in console_out)
+
+    def test_multiple_files_same_scores(self):
+        """
+        The quality statistics used to normalise scores are gathered per file and then merged, so
+        they should come out the same as for the single file.
+        """
+        single_out, return_code = self.run_command('filtlong --verbose --keep_percent 50 INPUT > OUTPUT')
+        self.assertEqual(return_code, 0)
+        split_out, return_code = self.run_command('filtlong --verbose --threads 2 --keep_percent 50 '
+                                                  'SPLIT_FILES > OUTPUT')
+        self.assertEqual(return_code, 0)
+        single_scores = sorted(x for x in single_out.splitlines() if x.startswith('test_sort_') and '\t' in x)
+        split_scores = sorted(x for x in split_out.splitlines() if x.startswith('test_sort_') and '\t' in x)
+        self.assertEqual(len(single_scores), 3)
+        self.assertEqual(single_scores, split_scores)
+
+    def test_directory(self):
+        console_out, return_code = self.run_command('filtlong --threads 2 --min_length 1 SPLIT_DIR > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.output_read_names(), ['test_sort_1', 'test_sort_2', 'test_sort_3'])
+
+    def test_glob(self):
+        console_out, return_code = self.run_command('filtlong --min_length 1 "SPLIT_DIR/reads_*.fastq" > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.output_read_names(), ['test_sort_1', 'test_sort_3'])
+
+    def test_duplicate_across_files(self):
+        console_out, return_code = self.run_command('filtlong --min_length 1 INPUT SPLIT_FILES > OUTPUT')
+        self.assertTrue('Error: duplicate read name: test_sort_1' in console_out)
+        self.assertEqual(return_code, 1)
+
+    def test_bad_glob(self):
+        console_out, return_code = self.run_command('filtlong --min_length 1 "SPLIT_DIR/nothing_*.fastq" > OUTPUT')
+        self.assertTrue('Error: cannot find file' in console_out)
+        self.assertEqual(return_code, 1)
+
+    def test_threads_too_low(self):
+        console_out, return_code = self.run_command('filtlong --min_length 1 --threads 0 INPUT > OUTPUT')
+        self.assertTrue('Error: the value for --threads must be a positive integer' in console_out)
+        self.assertEqual(return_code, 1)
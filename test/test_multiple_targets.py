@@ -0,0 +1,123 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+
+
+class TestMultipleTargets(unittest.TestCase):
+    """
+    These tests give several targets in one run and check that each output matches a run with
+    just that target.
+    """
+
+    @classmethod
+    def setUpClass(cls):
+        cls.temp_dir = tempfile.mkdtemp()
+        cls.input = os.path.join(cls.temp_dir, 'reads.fastq')
+        random.seed(0)
+        with open(cls.input, 'wt') as f:
+            for i in range(2000):
+                length = random.randint(100, 5000)
+                qual_chars = [chr(33 + q) for q in random.sample(range(2, 40), 3)]
+                quals = ''.join(random.choice(qual_chars) for _ in range(length // 50 + 1)) * 50
+                f.write('@read_' + str(i) + '\n' + 'ACGT' * (length // 4) + 'A' * (length % 4) +
+                        '\n+\n' + quals[:length] + '\n')
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.temp_dir)
+
+    def run_filtlong(self, options):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        command = binary_path + ' ' + options + ' ' + self.input
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True,
+                             cwd=self.temp_dir)
+        out, err = p.communicate()
+        return out, err.decode(), p.returncode
+
+    def output_path(self, name):
+        return os.path.join(self.temp_dir, name)
+
+    def test_target_bases_list(self):
+        _, console_out, return_code = self.run_filtlong('--target_bases 500k,2m,1m '
+                                                        '--output a.fastq,b.fastq,c.fastq')
+        self.assertEqual(return_code, 0)
+        self.assertTrue('(b.fastq)' in console_out)
+        for target, output in [('500k', 'a.fastq'), ('2m', 'b.fastq'), ('1m', 'c.fastq')]:
+            single_out, _, return_code = self.run_filtlong('--target_bases ' + target)
+            self.assertEqual(return_code, 0)
+            with open(self.output_path(output), 'rb') as f:
+                self.assertEqual(f.read(), single_out)
+
+    def test_keep_percent_list_with_one_target_bases(self):
+        """
+        A single --target_bases value applies to every --keep_percent target, with the more
+        stringent of the two winning.
+        """
+        _, _, return_code = self.run_filtlong('--keep_percent 10,50 --target_bases 1m --min_length 1000 '
+                                              '--output a.fastq,b.fastq')
+        self.assertEqual(return_code, 0)
+        for percent, output in [('10', 'a.fastq'), ('50', 'b.fastq')]:
+            single_out, _, _ = self.run_filtlong('--keep_percent ' + percent + ' --target_bases 1m '
+                                                 '--min_length 1000')
+            with open(self.output_path(output), 'rb') as f:
+                self.assertEqual(f.read(), single_out)
+
+    def test_nested_outputs(self):
+        """
+        Every target keeps a best-first prefix of the same ranking, so a smaller target's reads are
+        all in a larger target's output.
+        """
+        _, _, return_code = self.run_filtlong('--keep_percent 20,40,60 --output a.fastq,b.fastq,c.fastq')
+        self.assertEqual(return_code, 0)
+        names = [set(x[0] for x in load_fastq(self.output_path(f)))
+                 for f in ['a.fastq', 'b.fastq', 'c.fastq']]
+        self.assertTrue(names[0] < names[1] < names[2])
+
+    def test_single_output_file(self):
+        _, _, return_code = self.run_filtlong('--target_bases 1m --output a.fastq')
+        self.assertEqual(return_code, 0)
+        single_out, _, _ = self.run_filtlong('--target_bases 1m')
+        with open(self.output_path('a.fastq'), 'rb') as f:
+            self.assertEqual(f.read(), single_out)
+
+    def test_missing_outputs(self):
+        _, console_out, return_code = self.run_filtlong('--target_bases 1m,2m')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('one file per target' in console_out)
+
+    def test_mismatched_lists(self):
+        _, console_out, return_code = self.run_filtlong('--target_bases 1m,2m --keep_percent 10,20,30 '
+                                                        '--output a.fastq,b.fastq')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('same number of values' in console_out)
+
+    def test_too_many_outputs(self):
+        _, console_out, return_code = self.run_filtlong('--target_bases 1m --output a.fastq,b.fastq')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('more files than there are targets' in console_out)
+
+    def test_bad_list_value(self):
+        _, console_out, return_code = self.run_filtlong('--keep_percent 10,101 --output a.fastq,b.fastq')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('greater than 0 and less than 100' in console_out)
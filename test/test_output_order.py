@@ -0,0 +1,134 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import gzip
+import os
+import shutil
+import subprocess
+import tempfile
+from test import test_sort
+from test.test_bam import make_ubam, load_bam
+
+
+def load_fastq(fastq_text):
+    lines = fastq_text.strip().split('\n') if fastq_text.strip() else []
+    return [tuple(lines[i:i + 4]) for i in range(0, len(lines), 4)]
+
+
+class TestOutputOrder(unittest.TestCase):
+    """
+    With --output_order score, the output holds the same records as usual, but best first (as given
+    by the final scores in --scores_out).
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.table = os.path.join(self.temp_dir, 'scores.tsv')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(test_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', os.path.join(test_dir, 'test_reference.fasta'))
+        command = command.replace('TABLE', self.table)
+        command = command.replace('OUTPUT', os.path.join(self.temp_dir, 'out'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def final_scores(self):
+        with open(self.table, 'rt') as f:
+            lines = f.read().strip().split('\n')
+        header = lines[0].split('\t')
+        rows = [dict(zip(header, line.split('\t'))) for line in lines[1:]]
+        return {row['name']: float(row['final_score']) for row in rows}
+
+    def check_best_first(self, names):
+        scores = self.final_scores()
+        ordered = [scores[name] for name in names]
+        self.assertTrue(len(ordered) > 1)
+        self.assertEqual(ordered, sorted(ordered, reverse=True))
+
+    def check_order(self, options, input_name):
+        expected, _, return_code = self.run_command('filtlong ' + options + ' ' + input_name)
+        self.assertEqual(return_code, 0)
+        out, _, return_code = self.run_command('filtlong ' + options + ' --output_order score --scores_out TABLE ' +
+                                               input_name)
+        self.assertEqual(return_code, 0)
+        records = load_fastq(out)
+        self.assertEqual(sorted(records), sorted(load_fastq(expected)))
+        self.check_best_first([record[0][1:].split(' ')[0] for record in records])
+
+    def test_target_bases(self):
+        self.check_order('--target_bases 20000', 'INPUT')
+
+    def test_gzipped_input(self):
+        gzipped = os.path.join(self.temp_dir, 'in.fastq.gz')
+        with open(os.path.join(os.path.dirname(__file__), 'test_sort.fastq'), 'rb') as f:
+            with gzip.open(gzipped, 'wb') as g:
+                g.write(f.read())
+        self.check_order('--keep_percent 50', gzipped)
+
+    def test_split(self):
+        self.check_order('-a ASSEMBLY --split 100 --min_length 1', 'SPLIT')
+
+    def test_input_order(self):
+        expected, _, _ = self.run_command('filtlong --target_bases 20000 INPUT')
+        out, _, return_code = self.run_command('filtlong --target_bases 20000 --output_order input INPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(out, expected)
+
+    def test_multiple_targets(self):
+        outputs = ['OUTPUT_' + str(i) + '.fastq' for i in range(2)]
+        _, _, return_code = self.run_command('filtlong --target_bases 10000,20000 -o ' + ','.join(outputs) +
+                                             ' --output_order score --scores_out TABLE INPUT')
+        self.assertEqual(return_code, 0)
+        for i in range(2):
+            expected, _, _ = self.run_command('filtlong --target_bases ' + str(10000 * (i + 1)) + ' INPUT')
+            with open(os.path.join(self.temp_dir, 'out_' + str(i) + '.fastq'), 'rt') as f:
+                records = load_fastq(f.read())
+            self.assertEqual(sorted(records), sorted(load_fastq(expected)))
+            self.check_best_first([record[0][1:].split(' ')[0] for record in records])
+
+    def test_bam(self):
+        reads = test_sort.load_fastq(os.path.join(os.path.dirname(__file__), 'test_sort.fastq'))
+        bam = os.path.join(self.temp_dir, 'in.bam')
+        make_ubam(reads, bam)
+        _, _, return_code = self.run_command('filtlong --target_bases 20000 ' + bam + ' > OUTPUT_input.bam')
+        self.assertEqual(return_code, 0)
+        _, _, return_code = self.run_command('filtlong --target_bases 20000 --output_order score --scores_out TABLE ' +
+                                             bam + ' > OUTPUT_score.bam')
+        self.assertEqual(return_code, 0)
+        _, expected = load_bam(os.path.join(self.temp_dir, 'out_input.bam'))
+        _, records = load_bam(os.path.join(self.temp_dir, 'out_score.bam'))
+        self.assertEqual(sorted(records), sorted(expected))
+        self.check_best_first([record[0].decode() for record in records])
+
+    def test_bad_order(self):
+        _, err, return_code = self.run_command('filtlong --min_length 1 --output_order length INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--output_order' in err)
+
+    def test_not_with_streaming(self):
+        _, err, return_code = self.run_command('filtlong --streaming --min_length 1 --output_order score INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--output_order' in err)
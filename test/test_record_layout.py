@@ -0,0 +1,81 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import shutil
+import subprocess
+import tempfile
+
+
+class TestRecordLayout(unittest.TestCase):
+    """
+    Records in the usual layout are copied to the output as they are, while any other layout
+    (CRLF line endings, wrapped lines, a named '+' line, a tab before the comment) is rewritten in
+    the usual layout.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.input = os.path.join(self.temp_dir, 'in.fastq')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', self.input)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def check_output(self, input_text, expected):
+        with open(self.input, 'wt', newline='') as f:
+            f.write(input_text)
+        out, _, return_code = self.run_command('filtlong --min_length 1 INPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(out, expected)
+
+    def test_usual_layout(self):
+        records = '@read_1 runid=abc ch=12 start_time=2023-05-01T12:34:56Z\nACGTACGTAC\n+\nIIIIIIIIII\n' \
+                  '@read_2\nACGTAC\n+\n######\n'
+        self.check_output(records, records)
+
+    def test_crlf(self):
+        self.check_output('@read_1 comment\r\nACGTACGTAC\r\n+\r\nIIIIIIIIII\r\n',
+                          '@read_1 comment\nACGTACGTAC\n+\nIIIIIIIIII\n')
+
+    def test_wrapped_lines(self):
+        self.check_output('@read_1\nACGTA\nCGTAC\n+read_1\nIIIII\nIIIII\n@read_2\nACG\n+\nIII\n',
+                          '@read_1\nACGTACGTAC\n+\nIIIIIIIIII\n@read_2\nACG\n+\nIII\n')
+
+    def test_tab_before_comment(self):
+        self.check_output('@read_1\tcomment\nACGTACGTAC\n+\nIIIIIIIIII\n',
+                          '@read_1 comment\nACGTACGTAC\n+\nIIIIIIIIII\n')
+
+    def test_empty_comment_and_blank_lines(self):
+        self.check_output('@read_1 \nACGTACGTAC\n+\nIIIIIIIIII\n\n\n@read_2\nACG\n+\nIII',
+                          '@read_1\nACGTACGTAC\n+\nIIIIIIIIII\n@read_2\nACG\n+\nIII\n')
+
+    def test_long_record(self):
+        """
+        A record longer than the reader's buffer.
+        """
+        seq = 'ACGT' * 100000
+        records = '@read_1 long\n' + seq + '\n+\n' + 'I' * len(seq) + '\n@read_2\nACG\n+\nIII\n'
+        self.check_output(records, records)
@@ -0,0 +1,139 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+
+
+class TestScoreCache(unittest.TestCase):
+    """
+    The input files are copied to a temporary directory, so the tests can change them.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        for name in ['test_sort.fastq', 'test_split.fastq']:
+            shutil.copy(os.path.join(os.path.dirname(__file__), name), self.temp_dir)
+        self.cache = os.path.join(self.temp_dir, 'scores.cache')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        assembly_reference = os.path.join(os.path.dirname(__file__), 'test_reference.fasta')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(self.temp_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(self.temp_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', assembly_reference)
+        command = command.replace('CACHE', self.cache)
+        command = command.replace('OUTPUT', os.path.join(self.temp_dir, 'out.fastq'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        _, err = p.communicate()
+        return err.decode(), p.returncode
+
+    def output_reads(self):
+        return load_fastq(os.path.join(self.temp_dir, 'out.fastq'))
+
+    def test_cache_saved_then_loaded(self):
+        console_out, return_code = self.run_command('filtlong --score_cache CACHE --target_bases 10000 '
+                                                    'INPUT > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertTrue('Saved read scores' in console_out)
+        self.assertTrue(os.path.isfile(self.cache))
+        first_output = self.output_reads()
+
+        console_out, return_code = self.run_command('filtlong --score_cache CACHE --target_bases 10000 '
+                                                    'INPUT > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertTrue('Loading read scores' in console_out)
+        self.assertFalse('Scoring long reads' in console_out)
+        self.assertEqual(self.output_reads(), first_output)
+        self.assertEqual([x[0].decode() for x in first_output], ['test_sort_2', 'test_sort_3'])
+
+    def test_cache_new_thresholds(self):
+        """
+        Thresholds and weights aren't part of the cache, so changing them still uses it, and the
+        results match a run without the cache.
+        """
+        self.run_command('filtlong --score_cache CACHE --target_bases 10000 INPUT > OUTPUT')
+        for options in ['--target_bases 10000 --mean_q_weight 10', '--keep_percent 50',
+                        '--min_length 5000', '--min_mean_q 80 --length_weight 0.5']:
+            self.run_command('filtlong ' + options + ' INPUT > OUTPUT')
+            uncached_output = self.output_reads()
+            console_out, return_code = self.run_command('filtlong --score_cache CACHE ' + options +
+                                                        ' INPUT > OUTPUT')
+            self.assertEqual(return_code, 0)
+            self.assertTrue('Loading read scores' in console_out)
+            self.assertEqual(self.output_reads(), uncached_output)
+
+    def test_cache_made_without_window_weight(self):
+        """
+        Reads skip the window quality when nothing uses it, but a cache still gets it, so a later
+        run which does weight it matches a run without the cache.
+        """
+        self.run_command('filtlong --score_cache CACHE --window_q_weight 0 --target_bases 10000 '
+                         'INPUT > OUTPUT')
+        self.run_command('filtlong --window_q_weight 10 --target_bases 10000 INPUT > OUTPUT')
+        uncached_output = self.output_reads()
+        console_out, _ = self.run_command('filtlong --score_cache CACHE --window_q_weight 10 '
+                                          '--target_bases 10000 INPUT > OUTPUT')
+        self.assertTrue('Loading read scores' in console_out)
+        self.assertEqual(self.output_reads(), uncached_output)
+
+    def test_cache_split_verbose(self):
+        """
+        Child reads come back from the cache with the same ranges and scores.
+        """
+        command = 'filtlong --score_cache CACHE --verbose -a ASSEMBLY --split 100 SPLIT > OUTPUT'
+        scored_console_out, return_code = self.run_command(command)
+        self.assertEqual(return_code, 0)
+        scored_output = self.output_reads()
+        cached_console_out, return_code = self.run_command(command)
+        self.assertEqual(return_code, 0)
+        self.assertTrue('Loading read scores' in cached_console_out)
+        self.assertEqual(self.output_reads(), scored_output)
+        self.assertEqual(scored_console_out.split('Read name')[1], cached_console_out.split('Read name')[1])
+
+    def test_cache_different_settings(self):
+        self.run_command('filtlong --score_cache CACHE --min_length 1 INPUT > OUTPUT')
+        console_out, _ = self.run_command('filtlong --score_cache CACHE --min_length 1 --window_size 100 INPUT > OUTPUT')
+        self.assertFalse('Loading read scores' in console_out)
+        self.assertTrue('Saved read scores' in console_out)
+        console_out, _ = self.run_command('filtlong --score_cache CACHE --min_length 1 SPLIT > OUTPUT')
+        self.assertFalse('Loading read scores' in console_out)
+
+    def test_cache_changed_input(self):
+        self.run_command('filtlong --score_cache CACHE --min_length 1 INPUT > OUTPUT')
+        with open(os.path.join(self.temp_dir, 'test_sort.fastq'), 'at') as f:
+            f.write('@extra_read\nACGT\n+\nIIII\n')
+        console_out, return_code = self.run_command('filtlong --score_cache CACHE --min_length 1 INPUT > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertFalse('Loading read scores' in console_out)
+        self.assertTrue('extra_read' in [x[0].decode() for x in self.output_reads()])
+
+    def test_cache_not_a_cache(self):
+        with open(self.cache, 'wt') as f:
+            f.write('not a score cache\n')
+        console_out, return_code = self.run_command('filtlong --score_cache CACHE --min_length 1 INPUT > OUTPUT')
+        self.assertEqual(return_code, 0)
+        self.assertFalse('Loading read scores' in console_out)
+        self.assertTrue('Saved read scores' in console_out)
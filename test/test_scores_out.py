@@ -0,0 +1,125 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import gzip
+import os
+import shutil
+import subprocess
+import tempfile
+
+
+def output_names(fastq_text):
+    lines = fastq_text.strip().split('\n') if fastq_text.strip() else []
+    return [lines[i][1:].split(' ')[0] for i in range(0, len(lines), 4)]
+
+
+class TestScoresOut(unittest.TestCase):
+    """
+    --scores_out writes a table with a row for each read (or child read), which should agree with
+    --verbose's scores and with what was output.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.table = os.path.join(self.temp_dir, 'scores.tsv')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(test_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', os.path.join(test_dir, 'test_reference.fasta'))
+        command = command.replace('TABLE', self.table)
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def load_table(self, filename=None):
+        filename = filename if filename is not None else self.table
+        opener = gzip.open if filename.endswith('.gz') else open
+        with opener(filename, 'rt') as f:
+            lines = f.read().strip().split('\n')
+        header = lines[0].split('\t')
+        return [dict(zip(header, line.split('\t'))) for line in lines[1:]]
+
+    def test_matches_verbose(self):
+        """
+        The table's scores should agree with --verbose's (which rounds to two decimal places).
+        """
+        _, err, _ = self.run_command('filtlong --target_bases 10000 --verbose INPUT')
+        verbose_lines = err.split('Read name')[1].split('\n\n')[0].strip().split('\n')[1:]
+        verbose_scores = {}
+        for line in verbose_lines:
+            parts = [p.strip() for p in line.split('\t')]
+            verbose_scores[parts[0]] = [float(p) for p in parts[1:]]
+        out, _, return_code = self.run_command('filtlong --target_bases 10000 --scores_out TABLE INPUT')
+        self.assertEqual(return_code, 0)
+        rows = self.load_table()
+        self.assertEqual(len(rows), len(verbose_scores))
+        for row in rows:
+            scores = [float(row[c]) for c in ['length_score', 'mean_quality_score', 'window_quality_score',
+                                              'final_score']]
+            for a, b in zip(scores, verbose_scores[row['name']]):
+                self.assertAlmostEqual(a, b, delta=0.0051)
+            self.assertEqual(row['parent'], row['name'])
+            self.assertEqual(int(row['start']), 0)
+            self.assertEqual(int(row['end']), int(row['length']))
+        kept = [row['name'] for row in rows if row['kept'] == '1']
+        self.assertEqual(sorted(kept), sorted(output_names(out)))
+
+    def test_split(self):
+        out, _, return_code = self.run_command('filtlong -a ASSEMBLY --split 100 --target_bases 5000 '
+                                               '--scores_out TABLE SPLIT')
+        self.assertEqual(return_code, 0)
+        rows = self.load_table()
+        children = [row for row in rows if row['parent'] != row['name']]
+        self.assertTrue(len(children) > 0)
+        for row in children:
+            start, end = int(row['start']), int(row['end'])
+            self.assertEqual(row['name'], row['parent'] + '_' + str(start + 1) + '-' + str(end))
+            self.assertEqual(int(row['length']), end - start)
+        kept = [row['name'] for row in rows if row['kept'] == '1']
+        self.assertEqual(sorted(kept), sorted(output_names(out)))
+
+    def test_multiple_targets(self):
+        outputs = [os.path.join(self.temp_dir, 'out_' + str(i) + '.fastq') for i in range(2)]
+        _, _, return_code = self.run_command('filtlong --target_bases 10000,20000 -o ' + ','.join(outputs) +
+                                             ' --scores_out TABLE.gz INPUT')
+        self.assertEqual(return_code, 0)
+        rows = self.load_table(self.table + '.gz')
+        for i, output in enumerate(outputs):
+            with open(output, 'rt') as f:
+                names = output_names(f.read())
+            kept = [row['name'] for row in rows if row['kept'][i] == '1']
+            self.assertEqual(sorted(kept), sorted(names))
+
+    def test_failed_reads(self):
+        _, _, return_code = self.run_command('filtlong --min_length 5000 --scores_out TABLE INPUT')
+        self.assertEqual(return_code, 0)
+        for row in self.load_table():
+            passed = int(row['length']) >= 5000
+            self.assertEqual(row['passed'], '1' if passed else '0')
+            self.assertEqual(row['kept'], '1' if passed else '0')
+
+    def test_not_with_streaming(self):
+        _, err, return_code = self.run_command('filtlong --streaming --min_length 1 --scores_out TABLE INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--scores_out' in err)
@@ -0,0 +1,129 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+
+
+class TestSelection(unittest.TestCase):
+    """
+    These tests check which reads --target_bases keeps, using made-up reads where the answer is
+    easy to work out.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+        self.input = os.path.join(self.temp_dir, 'reads.fastq')
+        self.output = os.path.join(self.temp_dir, 'out.fastq')
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def write_reads(self, reads):
+        with open(self.input, 'wt') as f:
+            for name, length, qual in reads:
+                f.write('@' + name + '\n' + 'A' * length + '\n+\n' + qual * length + '\n')
+
+    def run_filtlong(self, options):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        command = binary_path + ' ' + options + ' ' + self.input + ' > ' + self.output
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        _, err = p.communicate()
+        self.assertEqual(p.returncode, 0)
+        return [x[0].decode() for x in load_fastq(self.output)]
+
+    def test_ties_go_to_earlier_reads(self):
+        """
+        The good reads all have the same score, so which of them are kept comes down to input
+        order.
+        """
+        reads = []
+        for i in range(50):
+            reads.append(('good_' + str(i), 1000, 'I'))
+            reads.append(('bad_' + str(i), 1000, '+'))
+        self.write_reads(reads)
+        kept = self.run_filtlong('--target_bases 25000')
+        self.assertEqual(kept, ['good_' + str(i) for i in range(25)])
+        kept = self.run_filtlong('--target_bases 24001')
+        self.assertEqual(kept, ['good_' + str(i) for i in range(25)])
+        kept = self.run_filtlong('--target_bases 60000')
+        expected = set(['good_' + str(i) for i in range(50)] + ['bad_' + str(i) for i in range(10)])
+        self.assertEqual(kept, [x[0] for x in reads if x[0] in expected])
+
+    def test_longest_reads(self):
+        """
+        With only the length score weighted, the kept reads should be the longest ones, up to the
+        first read which reaches the target.
+        """
+        random.seed(0)
+        lengths = random.sample(range(100, 20000), 2000)
+        reads = [('read_' + str(i), length, random.choice('+5?I')) for i, length in enumerate(lengths)]
+        self.write_reads(reads)
+        by_length = sorted(reads, key=lambda x: -x[1])
+        for target in [1, 5000, 1000000, 7777777, 20000000, 100000000]:
+            expected, total = set(), 0
+            for name, length, _ in by_length:
+                if total >= target:
+                    break
+                expected.add(name)
+                total += length
+            kept = self.run_filtlong('--mean_q_weight 0 --window_q_weight 0 --target_bases ' + str(target))
+            self.assertEqual(kept, [x[0] for x in reads if x[0] in expected])
+
+    def test_window_quality_with_length_threshold(self):
+        """
+        Reads which fail a length threshold skip measuring their window quality, unless --verbose
+        shows it. Either way, the same reads should be kept.
+        """
+        random.seed(2)
+        reads = []
+        for i in range(500):
+            qual = [random.choice('+5?I')] * random.randint(100, 3000)
+            if random.random() < 0.5:
+                start = random.randint(0, len(qual) - 1)
+                qual[start:start + 200] = '!' * len(qual[start:start + 200])
+            reads.append(('read_' + str(i), ''.join(qual)))
+        with open(self.input, 'wt') as f:
+            for name, qual in reads:
+                f.write('@' + name + '\n' + 'A' * len(qual) + '\n+\n' + qual + '\n')
+        for options in ['--min_length 1000 --window_q_weight 10 --target_bases 200000',
+                        '--max_length 2000 --min_window_q 50 --keep_percent 30']:
+            self.assertEqual(self.run_filtlong(options), self.run_filtlong(options + ' --verbose'))
+
+    def test_many_reads(self):
+        """
+        With over a million reads, the cut-off is found from histograms of the scores instead of
+        holding every read's score at once. The kept reads should be the same either way.
+        """
+        random.seed(1)
+        reads = [('r' + str(i), random.randint(1, 4), 'I') for i in range(1100000)]
+        self.write_reads(reads)
+        by_length = sorted(reads, key=lambda x: -x[1])
+        for target in [1234567, 2000000]:
+            expected, total = set(), 0
+            for name, length, _ in by_length:
+                if total >= target:
+                    break
+                expected.add(name)
+                total += length
+            kept = self.run_filtlong('--mean_q_weight 0 --window_q_weight 0 --target_bases ' + str(target))
+            self.assertEqual(kept, [x[0] for x in reads if x[0] in expected])
@@ -0,0 +1,96 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import gzip
+import os
+import shutil
+import subprocess
+import tempfile
+
+
+def split_records(fastq_text):
+    lines = fastq_text.strip().split('\n') if fastq_text.strip() else []
+    return ['\n'.join(lines[i:i + 4]) for i in range(0, len(lines), 4)]
+
+
+class TestShards(unittest.TestCase):
+    """
+    With --shards, the output is spread over several files, which between them hold exactly the
+    unsharded output.
+    """
+
+    def setUp(self):
+        self.temp_dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('OUTPUT', os.path.join(self.temp_dir, 'out'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def load_shard(self, filename):
+        path = os.path.join(self.temp_dir, filename)
+        if filename.endswith('.gz'):
+            with gzip.open(path, 'rt') as f:
+                return split_records(f.read())
+        with open(path, 'rt') as f:
+            return split_records(f.read())
+
+    def test_round_robin(self):
+        expected, _, _ = self.run_command('filtlong --target_bases 20000 INPUT')
+        expected = split_records(expected)
+        _, _, return_code = self.run_command('filtlong --target_bases 20000 --shards 3 -o OUTPUT.fastq INPUT')
+        self.assertEqual(return_code, 0)
+        shards = [self.load_shard('out_' + str(i) + '.fastq') for i in range(1, 4)]
+        self.assertEqual([len(s) for s in shards],
+                         [len(expected[0::3]), len(expected[1::3]), len(expected[2::3])])
+        self.assertEqual(shards, [expected[0::3], expected[1::3], expected[2::3]])
+
+    def test_by_bases(self):
+        expected, _, _ = self.run_command('filtlong --min_length 1 INPUT')
+        expected = split_records(expected)
+        _, _, return_code = self.run_command('filtlong --min_length 1 --shards 2 --shard_by bases '
+                                             '-o OUTPUT.fastq.gz INPUT')
+        self.assertEqual(return_code, 0)
+        shards = [self.load_shard('out_' + str(i) + '.fastq.gz') for i in range(1, 3)]
+        self.assertEqual(shards[0] + shards[1], expected)
+        self.assertTrue(len(shards[0]) > 0)
+        self.assertTrue(len(shards[1]) > 0)
+
+    def test_one_shard(self):
+        expected, _, _ = self.run_command('filtlong --target_bases 20000 INPUT')
+        _, _, return_code = self.run_command('filtlong --target_bases 20000 --shards 1 -o OUTPUT.fastq INPUT')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.load_shard('out.fastq'), split_records(expected))
+
+    def test_shards_need_output(self):
+        _, err, return_code = self.run_command('filtlong --min_length 1 --shards 2 INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--shards requires --output' in err)
+
+    def test_bad_shard_by(self):
+        _, err, return_code = self.run_command('filtlong --min_length 1 --shards 2 --shard_by length '
+                                               '-o OUTPUT.fastq INPUT')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--shard_by' in err)
@@ -0,0 +1,127 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+from test.test_sort import load_fastq
+
+
+class TestStreaming(unittest.TestCase):
+    """
+    These tests run Filtlong with --streaming on made-up reads of varied length and quality and
+    compare the results to a normal run.
+    """
+
+    @classmethod
+    def setUpClass(cls):
+        cls.temp_dir = tempfile.mkdtemp()
+        cls.input = os.path.join(cls.temp_dir, 'reads.fastq')
+        cls.output = os.path.join(cls.temp_dir, 'out.fastq')
+        random.seed(0)
+        cls.lengths = {}
+        with open(cls.input, 'wt') as f:
+            for i in range(5000):
+                name = 'read_' + str(i)
+                length = random.randint(100, 10000)
+                qual_chars = [chr(33 + q) for q in random.sample(range(2, 40), 4)]
+                quals = ''.join(random.choice(qual_chars) for _ in range(length // 50 + 1)) * 50
+                f.write('@' + name + '\n' + 'ACGT' * (length // 4) + 'A' * (length % 4) +
+                        '\n+\n' + quals[:length] + '\n')
+                cls.lengths[name] = length
+        cls.total_bases = sum(cls.lengths.values())
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.temp_dir)
+
+    def run_filtlong(self, options):
+        binary_path = os.path.join(os.path.dirname(os.path.dirname(__file__)), 'bin', 'filtlong')
+        command = binary_path + ' ' + options + ' ' + self.input + ' > ' + self.output
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        _, err = p.communicate()
+        return err.decode(), p.returncode
+
+    def output_read_names(self):
+        return [x[0].decode() for x in load_fastq(self.output)]
+
+    def test_hard_thresholds_match(self):
+        """
+        Without --target_bases or --keep_percent, nothing is estimated, so the output should be the
+        same as a normal run.
+        """
+        _, return_code = self.run_filtlong('--min_length 3000 --min_mean_q 80')
+        self.assertEqual(return_code, 0)
+        normal_names = self.output_read_names()
+        _, return_code = self.run_filtlong('--streaming --min_length 3000 --min_mean_q 80')
+        self.assertEqual(return_code, 0)
+        self.assertEqual(self.output_read_names(), normal_names)
+        self.assertTrue(len(normal_names) > 0)
+
+    def test_keep_percent(self):
+        _, return_code = self.run_filtlong('--keep_percent 40')
+        self.assertEqual(return_code, 0)
+        normal_names = self.output_read_names()
+        console_out, return_code = self.run_filtlong('--streaming --warm_up 500 --keep_percent 40')
+        self.assertEqual(return_code, 0)
+        self.assertTrue('kept:' in console_out)
+        streaming_names = self.output_read_names()
+
+        # Reads come out in input order and the bases kept should be close to the target.
+        self.assertEqual(streaming_names, sorted(streaming_names, key=lambda x: int(x.split('_')[1])))
+        kept_bases = sum(self.lengths[x] for x in streaming_names)
+        self.assertAlmostEqual(kept_bases / (0.4 * self.total_bases), 1.0, delta=0.05)
+
+        # Most of the reads should be the same ones a normal run keeps.
+        overlap = len(set(normal_names) & set(streaming_names))
+        self.assertTrue(overlap > 0.85 * len(normal_names))
+
+    def test_target_bases(self):
+        """
+        The target total is estimated from the input file size, and output stops once the target is
+        reached.
+        """
+        target = self.total_bases // 4
+        _, return_code = self.run_filtlong('--streaming --target_bases ' + str(target))
+        self.assertEqual(return_code, 0)
+        names = self.output_read_names()
+        kept_bases = sum(self.lengths[x] for x in names)
+        self.assertTrue(kept_bases < target + self.lengths[names[-1]])
+        self.assertAlmostEqual(kept_bases / target, 1.0, delta=0.05)
+
+    def test_small_warm_up(self):
+        """
+        With fewer reads than the warm-up, every read is held back and the threshold comes from all
+        of them.
+        """
+        _, return_code = self.run_filtlong('--streaming --warm_up 100000 --keep_percent 40')
+        self.assertEqual(return_code, 0)
+        kept_bases = sum(self.lengths[x] for x in self.output_read_names())
+        self.assertAlmostEqual(kept_bases / (0.4 * self.total_bases), 1.0, delta=0.02)
+
+    def test_score_cache_error(self):
+        console_out, return_code = self.run_filtlong('--streaming --score_cache x --keep_percent 40')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--streaming cannot be used with --score_cache' in console_out)
+
+    def test_bad_warm_up(self):
+        console_out, return_code = self.run_filtlong('--streaming --warm_up 0 --keep_percent 40')
+        self.assertEqual(return_code, 1)
+        self.assertTrue('--warm_up must be a positive integer' in console_out)
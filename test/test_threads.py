@@ -0,0 +1,68 @@
+"""
+Copyright 2017 Ryan Wick (rrwick@gmail.com)
+https://github.com/rrwick/Filtlong
+
+This module contains some tests for Filtlong. To run them, execute `python3 -m unittest` from the
+root Filtlong directory.
+
+This file is part of Filtlong. Filtlong is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by the Free Software Foundation,
+either version 3 of the License, or (at your option) any later version. Filtlong is distributed in
+the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+details. You should have received a copy of the GNU General Public License along with Filtlong. If
+not, see <http://www.gnu.org/licenses/>.
+"""
+
+import unittest
+import os
+import subprocess
+
+
+class TestThreads(unittest.TestCase):
+    """
+    Every stage shares one pool of --threads threads, and the output doesn't depend on how many
+    there are.
+    """
+
+    def run_command(self, command):
+        test_dir = os.path.dirname(__file__)
+        binary_path = os.path.join(os.path.dirname(test_dir), 'bin', 'filtlong')
+        command = command.replace('filtlong', binary_path)
+        command = command.replace('INPUT', os.path.join(test_dir, 'test_sort.fastq'))
+        command = command.replace('SPLIT', os.path.join(test_dir, 'test_split.fastq'))
+        command = command.replace('ASSEMBLY', os.path.join(test_dir, 'test_reference.fasta'))
+        command = command.replace('SHORT_1', os.path.join(test_dir, 'test_reference_1.fastq.gz'))
+        command = command.replace('SHORT_2', os.path.join(test_dir, 'test_reference_2.fastq.gz'))
+        p = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+        out, err = p.communicate()
+        return out.decode(), err.decode(), p.returncode
+
+    def check_same_output(self, command):
+        expected, _, return_code = self.run_command(command + ' --threads 1')
+        self.assertEqual(return_code, 0)
+        for threads in [2, 5]:
+            out, _, return_code = self.run_command(command + ' --threads ' + str(threads))
+            self.assertEqual(return_code, 0)
+            self.assertEqual(out, expected)
+
+    def test_quality_scores(self):
+        self.check_same_output('filtlong --target_bases 20000 INPUT')
+
+    def test_assembly(self):
+        self.check_same_output('filtlong -a ASSEMBLY --split 100 --target_bases 5000 SPLIT')
+
+    def test_short_reads(self):
+        self.check_same_output('filtlong -1 SHORT_1 -2 SHORT_2 --trim --min_length 1 SPLIT')
+
+    def test_utilisation_report(self):
+        _, err, return_code = self.run_command('filtlong -a ASSEMBLY --min_length 1 --threads 3 SPLIT')
+        self.assertEqual(return_code, 0)
+        self.assertTrue('Thread use (3 threads)' in err)
+        self.assertTrue('reference hashing' in err)
+        self.assertTrue('scoring' in err)
+
+    def test_no_report_with_one_thread(self):
+        _, err, return_code = self.run_command('filtlong --min_length 1 INPUT')
+        self.assertEqual(return_code, 0)
+        self.assertFalse('Thread use' in err)